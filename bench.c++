@@ -0,0 +1,410 @@
+// bench.cpp
+//
+// Throughput and latency of the u128 operations, with no dependencies beyond
+// the headers.
+//
+//      c++ -std=c++17 -O2 -I. bench.c++ -o bench
+//      ./bench                     all benchmarks
+//      ./bench div                 only those whose name contains "div"
+//      ./bench --csv > base.csv    machine readable, to keep as a baseline
+//      ./bench --compare base.csv  flag anything more than 10% slower than base.csv
+//                                  (not together with --csv)
+//
+// Throughput runs the operation over independent inputs (how many per second
+// the pipeline sustains); latency feeds each result into the next input (how
+// long one takes when something waits for it). Both are in nanoseconds per
+// operation, the minimum of several runs; bulk kernels report per element.
+// --compare exits with status 1 if any benchmark regressed, for use in CI.
+
+#include "u128.h"
+#include "u128_dispatch.h"
+#include "u128_simd.h"
+#include "u128_sort.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+
+namespace u128 {
+namespace bench {
+
+    // Makes the compiler assume v is used, so that the work producing it is kept.
+    // No memory clobber: that would force the inputs to be reloaded on every
+    // call, and the loop would measure the loads rather than the operation.
+    template<typename T>
+    inline void keep(const T& v) noexcept {
+#if defined(__GNUC__)
+        __asm__ __volatile__("" : : "r,m"(v));
+#else
+        static volatile char sink;
+        sink = *reinterpret_cast<const volatile char*>(&v);
+#endif
+    }
+
+    // Makes the compiler assume the memory at p is read, for results written
+    // to a buffer. This one does clobber memory, so use it once per bulk call.
+    inline void keep_memory(const void* p) noexcept {
+#if defined(__GNUC__)
+        __asm__ __volatile__("" : : "r"(p) : "memory");
+#else
+        static const void* volatile sink;
+        sink = p;
+#endif
+    }
+
+    // A u128 stays in its two registers.
+    inline void keep(const u128& v) noexcept {
+#if defined(__GNUC__)
+        __asm__ __volatile__("" : : "r"(v.lo), "r"(v.hi));
+#else
+        keep(v.lo ^ v.hi);
+#endif
+    }
+
+    // Inputs: N random values of each shape, small enough to stay in L1.
+    constexpr size_t N = 1024;
+
+    struct inputs {
+        std::vector<u64> a64, b64;
+        std::vector<u128> a, b, m;      // m: odd 128 bit moduli
+        std::vector<u128> small;        // below 2⁶⁴, as most counters are
+        std::vector<std::string> dec, hex;
+
+        inputs() {
+            std::mt19937_64 rng(2024);
+            for (size_t i = 0; i < N; i++) {
+                a64.push_back(rng());
+                b64.push_back(rng() | 1);
+                a.push_back(u128(rng(), rng()));
+                b.push_back(u128(rng(), rng() >> (rng() % 64)) | ONE);
+                m.push_back(u128(rng() | 1, rng() | 1));
+                small.push_back(u128(rng() >> (rng() % 64)));
+                dec.push_back(a.back().to_string());
+                hex.push_back(a.back().to_string_hex().substr(2));
+            }
+        }
+    };
+
+    const inputs& in() {
+        static const inputs data;
+        return data;
+    }
+
+    // Nanoseconds per call of f(i) for i in [0, n), repeated until a run takes
+    // a few milliseconds; the fastest of five runs.
+    template<typename F>
+    double time_ns(size_t n, F f) {
+        using clock = std::chrono::steady_clock;
+        size_t reps = 1;
+        double best = 1e300;
+        for (int run = 0; run < 5; ) {
+            const clock::time_point t0 = clock::now();
+            for (size_t r = 0; r < reps; r++)
+                for (size_t i = 0; i < n; i++)
+                    f(i);
+            const double ns = std::chrono::duration<double, std::nano>(clock::now() - t0).count();
+            if (ns < 5e6 && reps < (size_t(1) << 30)) {
+                reps *= 2;          // too short to time reliably
+                continue;
+            }
+            best = std::min(best, ns / (double(reps) * double(n)));
+            run++;
+        }
+        return best;
+    }
+
+    struct result {
+        double throughput;
+        double latency;     // negative if not measured
+    };
+
+    struct benchmark {
+        std::string name;
+        std::function<result()> run;
+    };
+
+    // A benchmark of op(x, i), with x a u128: for throughput x is an input, for
+    // latency the previous result.
+    template<typename Op>
+    benchmark chained(const char* name, Op op) {
+        return { name, [op] {
+            const inputs& d = in();
+            result r;
+            r.throughput = time_ns(N, [&](size_t i) { keep(op(d.a[i], i)); });
+            u128 x = d.a[0];
+            r.latency = time_ns(N, [&](size_t i) { x = op(x, i); });
+            keep(x);
+            return r;
+        } };
+    }
+
+    // A benchmark of f(i) for throughput only.
+    template<typename F>
+    benchmark independent(const char* name, F f) {
+        return { name, [f] { return result{ time_ns(N, f), -1.0 }; } };
+    }
+
+    // A bulk kernel over n elements, f() processing all of them.
+    template<typename F>
+    benchmark bulk(const char* name, size_t n, F f) {
+        return { name, [n, f] { return result{ time_ns(1, [&](size_t) { f(); }) / double(n), -1.0 }; } };
+    }
+
+    std::vector<benchmark> all() {
+        static const inputs& d = in();
+        std::vector<benchmark> b;
+
+        // Multiplication
+        b.push_back(chained("mul64", [&](const u128& x, size_t i) { return mul64(x.lo, d.b64[i]) ^ u128(0, x.hi); }));
+        b.push_back(chained("mul64_portable", [&](const u128& x, size_t i) { return mul64_portable(x.lo, d.b64[i]) ^ u128(0, x.hi); }));
+        b.push_back(chained("u128 * u128", [&](const u128& x, size_t i) { return x * d.b[i]; }));
+        b.push_back(chained("u128 * u64", [&](const u128& x, size_t i) { return x * d.b64[i]; }));
+        b.push_back(chained("mul128", [&](const u128& x, size_t i) { return mul128(x, d.b[i]).lo(); }));
+        b.push_back(chained("mulhi", [&](const u128& x, size_t i) { return mulhi(x, d.b[i]) ^ x; }));
+        b.push_back(chained("u256 * u256", [&](const u128& x, size_t i) { return (u256(x, d.a[i]) * u256(d.b[i], x)).lo(); }));
+
+        // Shifts
+        b.push_back(chained("u128 << n", [&](const u128& x, size_t i) { return (x << (unsigned)(d.a64[i] & 127)) | ONE; }));
+        b.push_back(chained("u128 >> n", [&](const u128& x, size_t i) { return (x >> (unsigned)(d.a64[i] & 127)) | u128(0, 1ULL << 63); }));
+        b.push_back(chained("rotl", [&](const u128& x, size_t i) { return rotl(x, (int)(d.a64[i] & 127)); }));
+
+        // Division
+        b.push_back(chained("u128 / u128", [&](const u128& x, size_t i) { return x / d.b[i] ^ x; }));
+        b.push_back(chained("u128 / u64", [&](const u128& x, size_t i) { return x / d.b64[i] ^ x; }));
+        b.push_back(chained("div128by64", [&](const u128& x, size_t i) {
+            // a divisor with the top bit set, so that any hi below 2⁶³ is in range
+            u64 rem;
+            return u128(div128by64(x.hi >> 1, x.lo, d.b64[i] | (1ULL << 63), rem), x.hi);
+        }));
+        b.push_back(chained("div128by64_portable", [&](const u128& x, size_t i) {
+            u64 rem;
+            return u128(div128by64_portable(x.hi >> 1, x.lo, d.b64[i] | (1ULL << 63), rem), x.hi);
+        }));
+        {
+            const u128_divider div(d.b[7]);
+            b.push_back(chained("u128_divider", [=](const u128& x, size_t) { return x / div ^ x; }));
+        }
+        b.push_back(chained("div_by<10>", [&](const u128& x, size_t) { return div_by<10>(x) ^ x; }));
+        b.push_back(chained("mulmod", [&](const u128& x, size_t i) { return mulmod(x, d.a[i], d.m[i]); }));
+        {
+            const montgomery128 mont(d.m[3]);
+            // (the inputs are not reduced mod n, which makes no difference to the time)
+            b.push_back(chained("montgomery128::mul", [=](const u128& x, size_t i) { return mont.mul(x, d.a[i]); }));
+        }
+
+        // Integer functions
+        b.push_back(chained("isqrt", [&](const u128& x, size_t) { return u128(isqrt(x), x.hi); }));
+        b.push_back(chained("ilog10", [&](const u128& x, size_t) { return x >> (unsigned)ilog10(x); }));
+        b.push_back(chained("gcd", [&](const u128& x, size_t i) { return gcd(x, d.b[i]) ^ x; }));
+
+        // Hashing and conversion
+        b.push_back(chained("hash128", [&](const u128& x, size_t) { return u128(hash128(x), x.hi); }));
+        b.push_back(chained("to_double", [&](const u128& x, size_t) {
+            const double f = to_double(x);
+            u64 bits;
+            std::memcpy(&bits, &f, sizeof(bits));
+            return u128(bits ^ x.lo, x.hi);
+        }));
+        b.push_back(independent("from_double", [&](size_t i) { keep(from_double(static_cast<double>(d.a64[i]) * 0x1p60)); }));
+
+        // Text
+        b.push_back(independent("to_string", [&](size_t i) { keep(d.a[i].to_string()); }));
+        b.push_back(independent("to_string (small)", [&](size_t i) { keep(d.small[i].to_string()); }));
+        b.push_back(independent("to_string_hex", [&](size_t i) { keep(d.a[i].to_string_hex()); }));
+        b.push_back(independent("to_chars", [&](size_t i) {
+            char buf[40];
+            keep(to_chars(buf, buf + sizeof(buf), d.a[i]).ptr);
+            keep_memory(buf);
+        }));
+        b.push_back(independent("write_hex_32", [&](size_t i) {
+            char buf[32];
+            keep(write_hex_32(buf, d.a[i]));
+            keep_memory(buf);
+        }));
+        b.push_back(independent("from_chars", [&](size_t i) {
+            u128 v;
+            const std::string& s = d.dec[i];
+            keep(from_chars(s.data(), s.data() + s.size(), v).ptr);
+            keep(v);
+        }));
+        b.push_back(independent("read_hex_32", [&](size_t i) {
+            u128 v;
+            keep(read_hex_32(d.hex[i].data(), v));
+            keep(v);
+        }));
+
+        // Serialization
+        b.push_back(independent("write_varint (small)", [&](size_t i) {
+            std::byte buf[VARINT_MAX_BYTES];
+            keep(write_varint(buf, d.small[i]));
+            keep_memory(buf);
+        }));
+        {
+            static std::vector<std::byte> enc(N * VARINT_MAX_BYTES);
+            static std::vector<u128> dec(N);
+            const std::byte* end = write_varints(enc.data(), d.small.data(), N);
+            b.push_back(bulk("read_varints (small)", N, [end] { keep(read_varints(enc.data(), end, dec.data(), N)); keep_memory(dec.data()); }));
+        }
+
+        // Batch kernels, on arrays that fit in L2
+        {
+            static std::vector<u128> out(N);
+            static bool lt[N];
+            static size_t h[N];
+            b.push_back(bulk("add_n", N, [&] { add_n(d.a.data(), d.b.data(), out.data(), N); keep_memory(out.data()); }));
+            b.push_back(bulk("xor_n", N, [&] { xor_n(d.a.data(), d.b.data(), out.data(), N); keep_memory(out.data()); }));
+            b.push_back(bulk("cmp_lt_n", N, [&] { cmp_lt_n(d.a.data(), d.b.data(), lt, N); keep_memory(lt); }));
+            b.push_back(bulk("mul64_n", N, [&] { mul64_n(d.a64.data(), d.b64.data(), out.data(), N); keep_memory(out.data()); }));
+            b.push_back(bulk("hash_n", N, [&] { hash_n(d.a.data(), h, N); keep_memory(h); }));
+            b.push_back(bulk("sum_u64_to_u128", N, [&] { keep(sum_u64_to_u128(d.a64.data(), N)); }));
+            b.push_back(bulk("dot_u64", N, [&] { keep(dot_u64(d.a64.data(), d.b64.data(), N)); }));
+            b.push_back(bulk("inclusive_scan", N, [&] { inclusive_scan(d.a.data(), out.data(), N); keep_memory(out.data()); }));
+        }
+
+        // Multi-limb kernels, dispatched separately
+        {
+            static std::vector<u256> wide_out(N);
+            static std::vector<u128> out(N);
+            const montgomery128 mont(d.m[3]);
+            b.push_back(bulk("mul128_n", N, [&] { mul128_n(d.a.data(), d.b.data(), wide_out.data(), N); keep_memory(wide_out.data()); }));
+            b.push_back(bulk("mont_mul_n", N, [&, mont] { mont_mul_n(mont, d.a.data(), d.b.data(), out.data(), N); keep_memory(out.data()); }));
+        }
+
+        // Sorting and searching, 64K keys
+        {
+            constexpr size_t K = 1 << 16;
+            static std::vector<u128> keys, work(K), sorted;
+            std::mt19937_64 rng(7);
+            for (size_t i = 0; i < K; i++)
+                keys.push_back(u128(rng(), rng() % 1000));
+            sorted = keys;
+            radix_sort(sorted.data(), K);
+            static const eytzinger_index index(sorted.data(), K);
+            b.push_back(bulk("radix_sort (64K)", K, [] {
+                work = keys;
+                radix_sort(work.data(), K);
+                keep_memory(work.data());
+            }));
+            b.push_back(bulk("std::sort (64K)", K, [] {
+                work = keys;
+                std::sort(work.begin(), work.end());
+                keep_memory(work.data());
+            }));
+            b.push_back(independent("std::lower_bound (64K)", [&](size_t i) {
+                keep(std::lower_bound(sorted.begin(), sorted.end(), keys[i * 61 % K]));
+            }));
+            b.push_back(independent("branchless_lower_bound (64K)", [&](size_t i) {
+                keep(branchless_lower_bound(sorted.data(), sorted.data() + K, keys[i * 61 % K]));
+            }));
+            b.push_back(independent("eytzinger_index (64K)", [&](size_t i) {
+                keep(index.lower_bound(keys[i * 61 % K]));
+            }));
+        }
+        return b;
+    }
+
+    const char* compiler() {
+#if defined(__clang__)
+        return "clang " __clang_version__;
+#elif defined(__GNUC__)
+        return "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+        static char buf[32];
+        std::snprintf(buf, sizeof(buf), "msvc %d", _MSC_VER);
+        return buf;
+#else
+        return "unknown";
+#endif
+    }
+
+    // Reads "name,throughput,latency" lines written by --csv.
+    std::map<std::string, result> read_baseline(const char* path) {
+        std::map<std::string, result> base;
+        FILE* f = std::fopen(path, "r");
+        if (!f) {
+            std::fprintf(stderr, "cannot open %s\n", path);
+            std::exit(2);
+        }
+        char line[512];
+        while (std::fgets(line, sizeof(line), f)) {
+            if (line[0] == '#')
+                continue;
+            char* c1 = std::strchr(line, ',');
+            char* c2 = c1 ? std::strchr(c1 + 1, ',') : nullptr;
+            if (!c2)
+                continue;
+            base[std::string(line, c1)] = { std::atof(c1 + 1), std::atof(c2 + 1) };
+        }
+        std::fclose(f);
+        return base;
+    }
+
+    int main(int argc, char** argv) {
+        bool csv = false;
+        const char* filter = "";
+        const char* baseline = nullptr;
+        double tolerance = 0.10;
+        for (int i = 1; i < argc; i++) {
+            if (!std::strcmp(argv[i], "--csv"))
+                csv = true;
+            else if (!std::strcmp(argv[i], "--compare") && i + 1 < argc)
+                baseline = argv[++i];
+            else if (!std::strcmp(argv[i], "--tolerance") && i + 1 < argc)
+                tolerance = std::atof(argv[++i]) / 100;
+            else
+                filter = argv[i];
+        }
+        if (csv && baseline) {
+            std::fprintf(stderr, "--csv and --compare cannot be combined\n");
+            return 2;
+        }
+        const std::map<std::string, result> base = baseline ? read_baseline(baseline) : std::map<std::string, result>();
+
+        std::printf(csv ? "# %s, %s\n" : "%s\n%s\n\n", compiler(), describe_dispatch().c_str());
+        if (!csv)
+            std::printf("%-30s %12s %12s%s\n", "", "throughput", "latency", baseline ? "   vs baseline" : "");
+
+        int regressions = 0;
+        for (const benchmark& bm : all()) {
+            if (!std::strstr(bm.name.c_str(), filter))
+                continue;
+            const result r = bm.run();
+            if (csv) {
+                std::printf("%s,%.3f,%.3f\n", bm.name.c_str(), r.throughput, r.latency);
+                continue;
+            }
+            std::printf("%-30s %9.2f ns", bm.name.c_str(), r.throughput);
+            if (r.latency >= 0)
+                std::printf(" %9.2f ns", r.latency);
+            else
+                std::printf(" %12s", "");
+            const auto it = base.find(bm.name);
+            if (it != base.end()) {
+                // the worse of the two ratios decides
+                double ratio = r.throughput / it->second.throughput;
+                if (r.latency >= 0 && it->second.latency > 0)
+                    ratio = std::max(ratio, r.latency / it->second.latency);
+                const bool slower = ratio > 1 + tolerance;
+                regressions += slower;
+                std::printf("   %+5.0f%%%s", (ratio - 1) * 100, slower ? "  REGRESSION" : "");
+            }
+            std::printf("\n");
+        }
+        if (regressions)
+            std::printf("\n%d benchmark(s) more than %.0f%% slower than %s\n", regressions, tolerance * 100, baseline);
+        return regressions ? 1 : 0;
+    }
+
+} // namespace bench
+} // namespace u128
+
+int main(int argc, char** argv) {
+    return u128::bench::main(argc, argv);
+}
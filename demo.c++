@@ -1,13 +1,13 @@
-// demo.cpp
+// demo.c++
 #include "u128.h"
 #include <iostream>
 
 int main() {
-    using namespace u128;
-    u128 a = 0xFFFFFFFFFFFFFFFFULL;
-    u128 b = a * a;
+    using u128::u128;       // the type, from the namespace of the same name
+    const u128 a(0xFFFFFFFFFFFFFFFFULL);
+    const u128 b = a * a;
     std::cout << a << " * " << a << " = " << b << '\n';
 
-    u128 c = (u128(1) << 100) + 42;
+    const u128 c = (u128(1) << 100) + 42;
     std::cout << "1<<100 + 42 = " << c << '\n';
 }
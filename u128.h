@@ -2,7 +2,14 @@
 // file u128.h
 
 // Set to 1 to enable verification, 0 otherwise
+#ifndef EnablePortableMultiplyVerification
 #define EnablePortableMultiplyVerification 0
+#endif
+
+// Set to 1 to compile self_test(); on by default along with the verification.
+#ifndef U128_SELF_TEST
+#define U128_SELF_TEST EnablePortableMultiplyVerification
+#endif
 
 // struct uint128_t 
 //      Holds lo and hi 64 bit components of a 128 bit unsigned integer.
@@ -11,38 +18,196 @@
 //      Returns a 128 bit product of two 64 bit unsigned integers. Uses
 //      intrinsics for performance where available.
 // 
+// u256 mul128(const u128& a, const u128& b)
+//      Returns the full 256 bit product of two 128 bit unsigned integers.
+//
+// struct i128, i128 mul64s(i64 a, i64 b)
+//      Signed two's complement 128 bit integer with the same layout as u128,
+//      and the full signed product of two 64 bit integers.
+//
+// uint_n<Limbs>, u256 = uint_n<4>, u512 = uint_n<8>
+//      Fixed width integers of any number of 64 bit limbs with the operators of
+//      u128, unrolled at compile time. uint_n<2> is u128 itself.
+//
+// u64 mulhi64(u64 a, u64 b), u128 mulhi(const u128& a, const u128& b)
+//      Return only the upper half of the double width product.
+// 
+// mac64(acc, a, b), fma(a, b, c), struct carry_save_accumulator
+//      Fused multiply-add and widening accumulation of u64 products.
+//
+// checked_add, checked_sub, checked_mul, saturating_add, saturating_sub, saturating_mul
+//      Arithmetic that reports, or clamps at, overflow instead of wrapping.
+//
+// countl_zero, countr_zero, popcount, bit_width, rotl, rotr
+//      Bit operations on u128 mirroring C++20 <bit>.
+//
+// u128 shld128(hi, lo, n), u128 shrd128(hi, lo, n)
+//      Branch free funnel shifts across two u128 words.
+//
+// u128 mulmod(a, b, m), u128 powmod(a, e, m), struct montgomery128
+//      Modular arithmetic for 128 bit moduli; Montgomery form for odd moduli.
+//
+// struct u128_divider
+//      Precomputed reciprocal for repeated division by the same runtime divisor.
+//
+// u128 div_by<D>(const u128& n), u64 mod_by<D>(const u128& n)
+//      Division by a compile-time constant D, with the reciprocal computed at compile time.
+//
+// u64 isqrt(x), int ilog2(x), int ilog10(x), u128 ipow(base, e), u128 gcd(a, b), u128 lcm(a, b)
+//      Integer square root, logarithms, powers, greatest common divisor and
+//      least common multiple.
+//
+// u64 hash128(const u128& v, u64 seed = 0), struct seeded_hash
+//      Fast, well mixed hash of a u128, also behind std::hash<u128>.
+//
+// u128 reduce(x, n), u128 uniform_below(rng, n), struct pcg64_dxsm
+//      Mapping to [0, n) without a division, unbiased random values below n, and
+//      a PCG generator with a u128 state.
+//
+// double to_double(const u128& x), u128 from_double(double d)
+// long double to_long_double(const u128& x), u128 from_long_double(long double d)
+//      Conversion to floating point rounding to nearest even, and back truncating.
+//
+// std::to_chars_result to_chars(char* first, char* last, const u128& value, int base = 10)
+//      Writes value in the given base, without allocating, following std::to_chars.
+//
+// char* write_hex_32(char* p, const u128& value)
+//      Writes exactly 32 zero-padded hex digits, without allocating.
+//
+// std::from_chars_result from_chars(const char* first, const char* last, u128& value, int base = 10)
+//      Reads value in the given base, without allocating, following std::from_chars.
+//
+// bool read_hex_32(const char* p, u128& value)
+//      Reads exactly 32 hex digits, the inverse of write_hex_32.
+//
+// bool from_string(std::string_view s, u128& value, int base = 10)
+//      Reads a whole string, the inverse of to_string() and to_string_hex().
+//
+// u128 load_le(const std::byte* p), load_be, store_le(std::byte* p, v), store_be
+//      Read and write 16 bytes in a fixed byte order, any alignment; also for arrays.
+//
+// std::byte* write_varint(std::byte* p, const u128& v), read_varint(first, last, v)
+//      LEB128 variable length encoding, 1 byte for values below 128 and at most
+//      19; also write_varints, read_varints for arrays.
+// 
 // inline uint128_t mul64_portable(u64 a, u64 b) noexcept {
 //      Portable 64×64 → 128-bit unsigned multiplication
 //      - No compiler intrinsics in core routine
 //      - Verified against hardware multiply on MSVC/GCC/Clang
 //      - Full test suite with random + corner cases
+//
+// int self_test(u64 seed = 1)
+//      With U128_SELF_TEST, randomized and corner case checks of everything
+//      above, each against an identity or a slow reference implementation
+//      rather than a compiler's 128 bit type; returns the number of failures.
 
 #include <assert.h>
+#include <cfloat>   // for LDBL_MANT_DIG
+#include <charconv> // for std::to_chars_result
+#include <cmath>    // for std::sqrt
+#include <cstddef>
 #include <cstdint>
-#include <iomanip>  // for std::hex, std::setfill, std::setw
-#include <sstream>
+#include <cstring>  // for std::memcpy
+#include <ostream>
 #include <string>
+#include <string_view>
+#include <type_traits>  // for std::is_constant_evaluated
+#include <utility>      // for std::index_sequence
 
 #if defined(_MSC_VER)
 #include <intrin.h>   // for _umul128 on MSVC (built-in 64×64→128 multiply)
+#elif defined(__GNUC__) && defined(__x86_64__)
+#include <x86intrin.h>  // for _addcarry_u64
 #endif
 
-#if EnablePortableMultiplyVerification 
+#if EnablePortableMultiplyVerification || U128_SELF_TEST
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <limits>
 #include <random>
+#include <sstream>
+#include <vector>
+#endif
+
+// U128_IS_CONSTANT_EVALUATED() is true during constant evaluation. Functions that
+// use intrinsics test it to switch to their portable (constexpr) equivalent,
+// which lets them be constexpr and still use the intrinsics at run time.
+//
+// U128_CONSTEXPR expands to constexpr when that test is available (C++20, or
+// __builtin_is_constant_evaluated in GCC 9+, Clang 9+ and MSVC 19.25+), and to
+// nothing otherwise. U128_HAS_CONSTEXPR_ARITH is 1 in the first case and 0 in
+// the second, to test in #if.
+#if defined(__cpp_lib_is_constant_evaluated)
+#define U128_IS_CONSTANT_EVALUATED() std::is_constant_evaluated()
+#elif defined(__has_builtin)
+#if __has_builtin(__builtin_is_constant_evaluated)
+#define U128_IS_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#endif
+#elif (defined(__GNUC__) && __GNUC__ >= 9) || (defined(_MSC_VER) && _MSC_VER >= 1925)
+#define U128_IS_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#endif
+
+#if defined(U128_IS_CONSTANT_EVALUATED)
+#define U128_CONSTEXPR constexpr
+#define U128_HAS_CONSTEXPR_ARITH 1
+#else
+#define U128_CONSTEXPR
+#define U128_HAS_CONSTEXPR_ARITH 0
+#define U128_IS_CONSTANT_EVALUATED() false
+#endif
+
+// U128_PORTABLE, if defined to 1 before including this header, removes the
+// multiply, divide and add with carry intrinsics (and the inline asm) in favour
+// of the portable code, to test or benchmark it, or for a compiler whose
+// intrinsics misbehave. mul64_path() tells which multiply a build uses.
+#ifndef U128_PORTABLE
+#define U128_PORTABLE 0
+#endif
+
+// U128_BIG_ENDIAN is 1 on big endian targets, 0 otherwise. MSVC targets are
+// always little endian.
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define U128_BIG_ENDIAN 1
+#else
+#define U128_BIG_ENDIAN 0
 #endif
 
 
 namespace u128 {
     using u64 = uint64_t;
-    using uint128_t = u128; // for people who love the _t suffix.
+    using i64 = int64_t;
 
     // forward declarations
     struct u128;
+    template<size_t Limbs> struct basic_uint;
+    struct i128;
+    using uint128_t = u128; // for people who love the _t suffix.
+    using int128_t = i128;
 
-    inline u128 mul64(u64 a, u64 b) noexcept;
+    // uint_n<Limbs>: the unsigned integer of Limbs 64 bit limbs. This is u128
+    // itself for two limbs, and basic_uint<Limbs> otherwise.
+    template<size_t Limbs> struct uint_n_select { using type = basic_uint<Limbs>; };
+    template<> struct uint_n_select<2> { using type = u128; };
+    template<size_t Limbs> using uint_n = typename uint_n_select<Limbs>::type;
+    using u256 = uint_n<4>;
+    using u512 = uint_n<8>;
+
+    inline U128_CONSTEXPR u128 mul64(u64 a, u64 b) noexcept;
     inline constexpr u128 mul64_portable(u64, u64) noexcept;
     inline constexpr u128 add64(u64 a, u64 b) noexcept;
+    inline constexpr u128 sub64(u64 a, u64 b) noexcept;
+    inline U128_CONSTEXPR u128 divmod(const u128& a, const u128& b, u128& rem) noexcept;
+    inline U128_CONSTEXPR u128 divmod(const u128& a, u64 b, u64& rem) noexcept;
+    inline U128_CONSTEXPR unsigned char addcarry64(unsigned char carry, u64 a, u64 b, u64& out) noexcept;
+    inline U128_CONSTEXPR unsigned char subborrow64(unsigned char borrow, u64 a, u64 b, u64& out) noexcept;
+    template<size_t L> inline U128_CONSTEXPR basic_uint<L> divmod(const basic_uint<L>& a, const basic_uint<L>& b, basic_uint<L>& rem) noexcept;
+    template<size_t L> inline U128_CONSTEXPR basic_uint<L> divmod(const basic_uint<L>& a, u64 b, u64& rem) noexcept;
+    inline std::to_chars_result to_chars(char* first, char* last, const u128& value, int base = 10) noexcept;
+    inline char* write_hex_32(char* p, const u128& value) noexcept;
+    inline char* write_hex_16(char* p, u64 v) noexcept;
+    inline char* write_digits_backward(char* p, u64 v) noexcept;
+    inline char* write_19_digits_backward(char* p, u64 v) noexcept;
 
 
     // u128: Simple struct to hold lo and hi parts of a 128 bit unsigned integer
@@ -61,40 +226,31 @@ namespace u128 {
         }
 
         // shifts
+        //
+        // Shift counts of 128 or more give zero. The shifts are branch free, since
+        // shift counts often come from data and would mispredict: the in-word shift
+        // is done by s = nbits % 64 (with lo >> (64 - s) split in two so that s == 0
+        // stays defined), then masks select the cross-word move for nbits ≥ 64 and
+        // clear everything for nbits ≥ 128. This compiles to shld/shrd plus cmov
+        // on x86-64 and to lsl/lsr/csel on AArch64.
         constexpr u128& operator<<=(unsigned nbits) noexcept {
-            if (nbits == 0)
-                return *this;
-            if (nbits >= 128) {
-                lo = hi = 0;
-                return *this;
-            }
-            if (nbits >= 64) {
-                hi = lo;
-                lo = 0;
-                nbits -= 64;
-            }
-            if (nbits > 0) {
-                hi = (hi << nbits) | (lo >> (64 - nbits));
-                lo <<= nbits;
-            }
+            const unsigned s = nbits & 63;
+            const u64 word = (u64)0 - ((nbits >> 6) & 1);      // all ones if moving a whole word
+            const u64 keep = (u64)0 - (u64)(nbits < 128);      // all zeros if shifting everything out
+            const u64 h = (hi << s) | ((lo >> 1) >> (63 - s));
+            const u64 l = lo << s;
+            hi = ((h & ~word) | (l & word)) & keep;
+            lo = l & ~word & keep;
             return *this;
         }
         constexpr u128& operator>>=(unsigned nbits) noexcept {
-            if (nbits == 0)
-                return *this;
-            if (nbits >= 128) {
-                lo = hi = 0;
-                return *this;
-            }
-            if (nbits >= 64) {
-                lo = hi;
-                hi = 0;
-                nbits -= 64;
-            }
-            if (nbits > 0) {
-                lo = (lo >> nbits) | (hi << (64 - nbits));
-                hi >>= nbits;
-            }
+            const unsigned s = nbits & 63;
+            const u64 word = (u64)0 - ((nbits >> 6) & 1);
+            const u64 keep = (u64)0 - (u64)(nbits < 128);
+            const u64 l = (lo >> s) | ((hi << 1) << (63 - s));
+            const u64 h = hi >> s;
+            lo = ((l & ~word) | (h & word)) & keep;
+            hi = h & ~word & keep;
             return *this;
         }
         constexpr u128 operator<<(unsigned nbits) const noexcept {
@@ -164,25 +320,71 @@ namespace u128 {
         }
         friend constexpr u128 operator+(const u64 a, const u128& b) { return u128(a) += b; }
 
+        // - operators can underflow silently (wrap modulo 2¹²⁸).
+        constexpr u128& operator-=(const u128& other) {
+            // Handles borrow at the 64 bit position.
+            // Does not handle underflow at the 128 bit level
+#if defined(_MSC_VER) && defined(_M_X64) && !U128_PORTABLE
+            // sub, sbb: MSVC does not fuse the compare below into the subtraction
+            if (!U128_IS_CONSTANT_EVALUATED()) {
+                subborrow64(subborrow64(0, lo, other.lo, lo), hi, other.hi, hi);
+                return *this;
+            }
+#endif
+#if defined(__GNUC__)
+            const u64 borrow = __builtin_sub_overflow(lo, other.lo, &lo);
+#else
+            const u64 borrow = lo < other.lo;
+            lo -= other.lo;
+#endif
+            hi -= other.hi + borrow;
+            return *this;
+        }
+        constexpr u128& operator-=(const u64 other) {
+#if defined(_MSC_VER) && defined(_M_X64) && !U128_PORTABLE
+            if (!U128_IS_CONSTANT_EVALUATED()) {
+                subborrow64(subborrow64(0, lo, other, lo), hi, 0, hi);
+                return *this;
+            }
+#endif
+#if defined(__GNUC__)
+            hi -= __builtin_sub_overflow(lo, other, &lo);
+#else
+            hi -= (lo < other);
+            lo -= other;
+#endif
+            return *this;
+        }
+        constexpr u128 operator-(const u128& other) const {
+            return u128(*this) -= other;
+        }
+        constexpr u128 operator-(const u64 other) const {
+            return u128(*this) -= other;
+        }
+        constexpr u128 operator-() const {
+            return u128() -= *this;
+        }
+        friend constexpr u128 operator-(const u64 a, const u128& b) { return u128(a) -= b; }
+
         // * operators can overflow silently.
 
         // Warning: all multiplication operators are performed modulo 2¹²⁸ to be consistent
-        // with the way std::uint64_t works. Full 256 bit multiplication requires an external
-        // function, possibly something like this:
+        // with the way std::uint64_t works. Full 256 bit multiplication is provided by
+        // the free function
         //      u256 mul128( const u128& a, const u128& b )
-        // But, at this time a u256 class has not been built.
         //
-        // constexpr discussion: since the intrinsic _umul128 is not const, we had to decide
-        // between making the multiplications constexpr, which would require the use of the
-        // slower mul64_portable, or not constexpr, which gives us the ability to use the intrinsics.
-        // For performance reasons we chose the second option.
+        // constexpr discussion: the intrinsic _umul128 is not constexpr, so mul64 asks
+        // the compiler whether it is being constant evaluated, and if so uses the slower
+        // mul64_portable instead. Run time calls still get the intrinsic. The operators are
+        // therefore constexpr wherever U128_CONSTEXPR is (C++20, or any recent compiler
+        // in C++17 mode), and plain inline otherwise.
 
-        u128 operator*(const u64 other) const noexcept {
+        U128_CONSTEXPR u128 operator*(const u64 other) const noexcept {
             u128 p_lo = mul64(lo, other);
             u128 p_hi = mul64(hi, other);
             return p_lo + (p_hi << 64); // discard upper bits of p_hi
         }
-        u128 operator*(const u128& other) const noexcept {
+        U128_CONSTEXPR u128 operator*(const u128& other) const noexcept {
             // Use full 128×64 muls and add with carry
             u128 res = mul64(lo, other.lo);                    // lo * lo
             res += mul64(lo, other.hi) << 64;                  // lo * hi
@@ -190,33 +392,76 @@ namespace u128 {
             // hi * hi << 128 → discarded (mod 2¹²⁸)
             return res;
         }
-        u128& operator*=(const u64 other) noexcept {
+        U128_CONSTEXPR u128& operator*=(const u64 other) noexcept {
             *this = (*this) * other;
             return *this;
         }
-        u128& operator*=(const u128& other) noexcept {
+        U128_CONSTEXPR u128& operator*=(const u128& other) noexcept {
             *this = (*this) * other;
             return *this;
         }
-        friend u128 operator*(const u64 a, const u128& b) noexcept { return b * a; }
+        friend U128_CONSTEXPR u128 operator*(const u64 a, const u128& b) noexcept { return b * a; }
+
+        // / and % operators. Division by zero is undefined, as with std::uint64_t.
+        //
+        // A divisor that fits in 64 bits takes the fast path in divmod(): one hardware
+        // divide when hi < divisor, two otherwise. Larger divisors always produce a
+        // quotient that fits in 64 bits, which takes a single normalized divide.
+
+        U128_CONSTEXPR u128 operator/(const u128& other) const noexcept {
+            u128 rem;
+            return divmod(*this, other, rem);
+        }
+        U128_CONSTEXPR u128 operator/(const u64 other) const noexcept {
+            u64 rem = 0;
+            return divmod(*this, other, rem);
+        }
+        U128_CONSTEXPR u128 operator%(const u128& other) const noexcept {
+            u128 rem;
+            divmod(*this, other, rem);
+            return rem;
+        }
+        U128_CONSTEXPR u128 operator%(const u64 other) const noexcept {
+            u64 rem = 0;
+            divmod(*this, other, rem);
+            return u128(rem);
+        }
+        U128_CONSTEXPR u128& operator/=(const u128& other) noexcept {
+            *this = (*this) / other;
+            return *this;
+        }
+        U128_CONSTEXPR u128& operator/=(const u64 other) noexcept {
+            *this = (*this) / other;
+            return *this;
+        }
+        U128_CONSTEXPR u128& operator%=(const u128& other) noexcept {
+            *this = (*this) % other;
+            return *this;
+        }
+        U128_CONSTEXPR u128& operator%=(const u64 other) noexcept {
+            *this = (*this) % other;
+            return *this;
+        }
+        friend U128_CONSTEXPR u128 operator/(const u64 a, const u128& b) noexcept { return u128(a) / b; }
+        friend U128_CONSTEXPR u128 operator%(const u64 a, const u128& b) noexcept { return u128(a) % b; }
 
         // printing functions
 
         std::string to_string() const {
-            if (hi == 0) return std::to_string(lo);
-            return std::to_string(hi) + "_" + std::to_string(lo);  // or hex
+            // decimal; at most 39 characters
+            char buf[39];
+            return std::string(buf, to_chars(buf, buf + sizeof(buf), *this).ptr);
         }
         std::string to_string_hex() const {
             // always outputs 34 characters
-            std::ostringstream oss;
-            oss << "0x"
-                << std::hex << std::setfill('0')
-                << std::setw(16) << hi
-                << std::setw(16) << lo;
-            return oss.str();
+            char buf[34] = { '0', 'x' };
+            write_hex_32(buf + 2, *this);
+            return std::string(buf, sizeof(buf));
         }
         friend std::ostream& operator<<(std::ostream& os, const u128& v) {
-            return os << v.to_string_hex();
+            char buf[34] = { '0', 'x' };
+            write_hex_32(buf + 2, v);
+            return os << std::string_view(buf, sizeof(buf));
         }
     };
 
@@ -224,6 +469,398 @@ namespace u128 {
     static constexpr u128 ONE{ 1, 0 };
     static constexpr u128 MAX{ UINT64_MAX, UINT64_MAX };
 
+    // -----------------------------------------------------------------------------
+    // Fixed width integers of any number of limbs
+    // -----------------------------------------------------------------------------
+
+    template<size_t N, typename F, size_t... I>
+    constexpr void unroll_impl(F& f, std::index_sequence<I...>) {
+        (f(std::integral_constant<size_t, I>()), ...);
+    }
+
+    // Calls f(std::integral_constant<size_t, I>()) for I = 0 .. N-1 in order. Each
+    // call sees its index as a compile time constant, so a loop over limbs
+    // becomes straight-line code, e.g. a single add-with-carry chain.
+    template<size_t N, typename F>
+    constexpr void unroll(F f) {
+        unroll_impl<N>(f, std::make_index_sequence<N>());
+    }
+
+    // basic_uint<Limbs>: an unsigned integer of Limbs 64 bit limbs, least
+    // significant limb first, with the operators of u128. Arithmetic wraps
+    // modulo 2^(64·Limbs). Normally spelled uint_n<Limbs> (u256, u512, ...),
+    // which leaves two limbs to u128.
+    //
+    // All limb loops go through unroll, so for ECC and hash sized values
+    // + and - are one carry chain of addcarry64, * is rows of mul64, and
+    // shifts and comparisons are branch free. Division uses Knuth's Algorithm
+    // D over 64 bit digits.
+    template<size_t Limbs>
+    struct basic_uint {
+        static_assert(Limbs >= 2, "basic_uint needs at least two limbs");
+        static constexpr size_t limbs = Limbs;
+
+        u64 limb[Limbs];
+
+        constexpr basic_uint() noexcept : limb{} {}
+        explicit constexpr basic_uint(u64 v) noexcept : limb{ v } {}
+        explicit constexpr basic_uint(const u128& v) noexcept : limb{ v.lo, v.hi } {}
+
+        // From lower and upper halves, e.g. two u128 for a u256.
+        template<size_t L = Limbs, typename std::enable_if<L % 2 == 0, int>::type = 0>
+        constexpr basic_uint(const uint_n<L / 2>& lo_, const uint_n<L / 2>& hi_) noexcept : limb{} {
+            unroll<L / 2>([&](auto i) {
+                limb[i] = limb_of(lo_, i);
+                limb[i + L / 2] = limb_of(hi_, i);
+            });
+        }
+
+        // Zero extends or truncates another width.
+        template<size_t M>
+        explicit constexpr basic_uint(const basic_uint<M>& v) noexcept : limb{} {
+            unroll<(M < Limbs ? M : Limbs)>([&](auto i) { limb[i] = v.limb[i]; });
+        }
+
+        // lower and upper halves
+        template<size_t L = Limbs, typename std::enable_if<L % 2 == 0, int>::type = 0>
+        constexpr uint_n<L / 2> lo() const noexcept { return half<uint_n<L / 2>>(0); }
+        template<size_t L = Limbs, typename std::enable_if<L % 2 == 0, int>::type = 0>
+        constexpr uint_n<L / 2> hi() const noexcept { return half<uint_n<L / 2>>(L / 2); }
+
+        // shifts
+        //
+        // As for u128: counts of 64·Limbs or more give zero, and there are no
+        // branches. Each limb combines the two source limbs the whole-limb part
+        // of the count selects, shifted by the in-limb part.
+        constexpr basic_uint& operator<<=(unsigned nbits) noexcept {
+            const unsigned s = nbits & 63;
+            const size_t q = nbits >> 6;
+            const basic_uint a = *this;
+            unroll<Limbs>([&](auto i) {
+                const u64 cur = i >= q ? a.limb[i - q] : 0;
+                const u64 below = i >= q + 1 ? a.limb[i - q - 1] : 0;
+                limb[i] = (cur << s) | ((below >> 1) >> (63 - s));
+            });
+            return *this;
+        }
+        constexpr basic_uint& operator>>=(unsigned nbits) noexcept {
+            const unsigned s = nbits & 63;
+            const size_t q = nbits >> 6;
+            const basic_uint a = *this;
+            unroll<Limbs>([&](auto i) {
+                const u64 cur = i + q < Limbs ? a.limb[i + q] : 0;
+                const u64 above = i + q + 1 < Limbs ? a.limb[i + q + 1] : 0;
+                limb[i] = (cur >> s) | ((above << 1) << (63 - s));
+            });
+            return *this;
+        }
+        constexpr basic_uint operator<<(unsigned nbits) const noexcept { return basic_uint(*this) <<= nbits; }
+        constexpr basic_uint operator>>(unsigned nbits) const noexcept { return basic_uint(*this) >>= nbits; }
+
+        // bitwise
+        constexpr basic_uint operator~() const noexcept {
+            basic_uint r;
+            unroll<Limbs>([&](auto i) { r.limb[i] = ~limb[i]; });
+            return r;
+        }
+        constexpr basic_uint& operator&=(const basic_uint& o) noexcept {
+            unroll<Limbs>([&](auto i) { limb[i] &= o.limb[i]; });
+            return *this;
+        }
+        constexpr basic_uint& operator^=(const basic_uint& o) noexcept {
+            unroll<Limbs>([&](auto i) { limb[i] ^= o.limb[i]; });
+            return *this;
+        }
+        constexpr basic_uint& operator|=(const basic_uint& o) noexcept {
+            unroll<Limbs>([&](auto i) { limb[i] |= o.limb[i]; });
+            return *this;
+        }
+        constexpr basic_uint operator&(const basic_uint& o) const noexcept { return basic_uint(*this) &= o; }
+        constexpr basic_uint operator^(const basic_uint& o) const noexcept { return basic_uint(*this) ^= o; }
+        constexpr basic_uint operator|(const basic_uint& o) const noexcept { return basic_uint(*this) |= o; }
+
+        // comparison operators
+        constexpr bool operator==(const basic_uint& o) const noexcept {
+            u64 diff = 0;
+            unroll<Limbs>([&](auto i) { diff |= limb[i] ^ o.limb[i]; });
+            return diff == 0;
+        }
+        constexpr bool operator!=(const basic_uint& o) const noexcept { return !(*this == o); }
+        constexpr bool operator<(const basic_uint& o) const noexcept {
+            // From the bottom up: a higher limb decides unless it is equal.
+            bool lt = false;
+            unroll<Limbs>([&](auto i) { lt = (limb[i] < o.limb[i]) | ((limb[i] == o.limb[i]) & lt); });
+            return lt;
+        }
+        constexpr bool operator<=(const basic_uint& o) const noexcept { return !(o < *this); }
+        constexpr bool operator>(const basic_uint& o) const noexcept { return o < *this; }
+        constexpr bool operator>=(const basic_uint& o) const noexcept { return !(*this < o); }
+
+        // + and - wrap modulo 2^(64·Limbs).
+        U128_CONSTEXPR basic_uint& operator+=(const basic_uint& o) noexcept {
+            unsigned char c = 0;
+            unroll<Limbs>([&](auto i) { c = addcarry64(c, limb[i], o.limb[i], limb[i]); });
+            return *this;
+        }
+        U128_CONSTEXPR basic_uint& operator+=(u64 o) noexcept { return *this += basic_uint(o); }
+        U128_CONSTEXPR basic_uint& operator-=(const basic_uint& o) noexcept {
+            // a - b = a + ~b + 1
+            unsigned char c = 1;
+            unroll<Limbs>([&](auto i) { c = addcarry64(c, limb[i], ~o.limb[i], limb[i]); });
+            return *this;
+        }
+        U128_CONSTEXPR basic_uint& operator-=(u64 o) noexcept { return *this -= basic_uint(o); }
+        U128_CONSTEXPR basic_uint operator+(const basic_uint& o) const noexcept { return basic_uint(*this) += o; }
+        U128_CONSTEXPR basic_uint operator+(u64 o) const noexcept { return basic_uint(*this) += o; }
+        U128_CONSTEXPR basic_uint operator-(const basic_uint& o) const noexcept { return basic_uint(*this) -= o; }
+        U128_CONSTEXPR basic_uint operator-(u64 o) const noexcept { return basic_uint(*this) -= o; }
+        U128_CONSTEXPR basic_uint operator-() const noexcept { return basic_uint() -= *this; }
+        friend U128_CONSTEXPR basic_uint operator+(u64 a, const basic_uint& b) noexcept { return b + a; }
+        friend U128_CONSTEXPR basic_uint operator-(u64 a, const basic_uint& b) noexcept { return basic_uint(a) -= b; }
+
+        // * wraps modulo 2^(64·Limbs): schoolbook rows, skipping the products
+        // that only reach bits above the top limb. mul_wide() keeps them all.
+        U128_CONSTEXPR basic_uint operator*(const basic_uint& o) const noexcept {
+            basic_uint r;
+            unroll<Limbs>([&](auto i) {
+                constexpr size_t I = decltype(i)::value;
+                u64 carry = 0;
+                unroll<Limbs - I>([&](auto j) {
+                    if constexpr (I + decltype(j)::value + 1 < Limbs) {
+                        const u128 t = mul64(limb[i], o.limb[j]) + r.limb[i + j] + carry;
+                        r.limb[i + j] = t.lo;
+                        carry = t.hi;
+                    }
+                    else {
+                        r.limb[i + j] += limb[i] * o.limb[j] + carry;     // top limb: low half only
+                    }
+                });
+            });
+            return r;
+        }
+        U128_CONSTEXPR basic_uint operator*(u64 o) const noexcept {
+            basic_uint r;
+            u64 carry = 0;
+            unroll<Limbs>([&](auto i) {
+                const u128 t = mul64(limb[i], o) + carry;
+                r.limb[i] = t.lo;
+                carry = t.hi;
+            });
+            return r;
+        }
+        U128_CONSTEXPR basic_uint& operator*=(const basic_uint& o) noexcept { return *this = *this * o; }
+        U128_CONSTEXPR basic_uint& operator*=(u64 o) noexcept { return *this = *this * o; }
+        friend U128_CONSTEXPR basic_uint operator*(u64 a, const basic_uint& b) noexcept { return b * a; }
+
+        // / and %. Division by zero is undefined, as with u128.
+        U128_CONSTEXPR basic_uint operator/(const basic_uint& o) const noexcept {
+            basic_uint rem;
+            return divmod(*this, o, rem);
+        }
+        U128_CONSTEXPR basic_uint operator/(u64 o) const noexcept {
+            u64 rem = 0;
+            return divmod(*this, o, rem);
+        }
+        U128_CONSTEXPR basic_uint operator%(const basic_uint& o) const noexcept {
+            basic_uint rem;
+            divmod(*this, o, rem);
+            return rem;
+        }
+        U128_CONSTEXPR basic_uint operator%(u64 o) const noexcept {
+            u64 rem = 0;
+            divmod(*this, o, rem);
+            return basic_uint(rem);
+        }
+        U128_CONSTEXPR basic_uint& operator/=(const basic_uint& o) noexcept { return *this = *this / o; }
+        U128_CONSTEXPR basic_uint& operator/=(u64 o) noexcept { return *this = *this / o; }
+        U128_CONSTEXPR basic_uint& operator%=(const basic_uint& o) noexcept { return *this = *this % o; }
+        U128_CONSTEXPR basic_uint& operator%=(u64 o) noexcept { return *this = *this % o; }
+
+        // printing functions
+
+        std::string to_string() const {
+            // decimal, 19 digits per division by 10¹⁹; 64 bits take at most 20 digits
+            char buf[20 * Limbs];
+            char* p = buf + sizeof(buf);
+            basic_uint v = *this;
+            while (v > basic_uint(UINT64_MAX)) {
+                u64 r = 0;
+                v = divmod(v, 10000000000000000000ULL, r);
+                p = write_19_digits_backward(p, r);
+            }
+            p = write_digits_backward(p, v.limb[0]);
+            return std::string(p, buf + sizeof(buf));
+        }
+        std::string to_string_hex() const {
+            // always outputs 2 + 16·Limbs characters
+            char buf[2 + 16 * Limbs] = { '0', 'x' };
+            char* p = buf + 2;
+            for (size_t i = Limbs; i-- > 0;)
+                p = write_hex_16(p, limb[i]);
+            return std::string(buf, sizeof(buf));
+        }
+        friend std::ostream& operator<<(std::ostream& os, const basic_uint& v) {
+            return os << v.to_string_hex();
+        }
+
+    private:
+        static constexpr u64 limb_of(const u128& v, size_t i) noexcept { return i == 0 ? v.lo : v.hi; }
+        template<size_t M>
+        static constexpr u64 limb_of(const basic_uint<M>& v, size_t i) noexcept { return v.limb[i]; }
+
+        // The Limbs / 2 limbs from first as a uint_n.
+        template<typename H>
+        constexpr H half(size_t first) const noexcept {
+            if constexpr (std::is_same<H, u128>::value) {
+                return u128(limb[first], limb[first + 1]);
+            }
+            else {
+                H h;
+                unroll<H::limbs>([&](auto i) { h.limb[i] = limb[first + i]; });
+                return h;
+            }
+        }
+    };
+
+    // -----------------------------------------------------------------------------
+    // Signed 128 bit integers
+    // -----------------------------------------------------------------------------
+
+    // i128: a two's complement signed 128 bit integer. It has the same lo, hi
+    // layout as u128, with the sign in the top bit of hi, and converts to and
+    // from u128 by reinterpreting those bits, which costs nothing.
+    //
+    // +, -, *, << and the bitwise operators are the u128 ones, since two's
+    // complement makes them identical (and they wrap modulo 2¹²⁸ the same
+    // way). >> shifts in copies of the sign bit, comparisons are signed, and
+    // / and % truncate toward zero, as for the built in signed types. None of
+    // them branch on the sign.
+    struct i128 {
+        u64 lo, hi;
+
+        constexpr i128() : lo(0), hi(0) {}
+        explicit constexpr i128(i64 v) : lo((u64)v), hi((u64)(v >> 63)) {}
+        constexpr i128(u64 lo_, u64 hi_) : lo(lo_), hi(hi_) {}
+        explicit constexpr i128(const u128& v) : lo(v.lo), hi(v.hi) {}
+        explicit constexpr operator u128() const noexcept { return u128(lo, hi); }
+
+        // All ones if negative, else zero.
+        constexpr u128 sign_mask() const noexcept {
+            const u64 s = (u64)((i64)hi >> 63);
+            return u128(s, s);
+        }
+        constexpr bool is_negative() const noexcept { return (i64)hi < 0; }
+
+        // shifts
+        constexpr i128& operator<<=(unsigned nbits) noexcept { return *this = i128(u128(*this) << nbits); }
+        constexpr i128& operator>>=(unsigned nbits) noexcept {
+            // Complementing a negative value makes it non-negative, so a logical
+            // shift of it, complemented back, is the arithmetic shift.
+            const u128 s = sign_mask();
+            return *this = i128(((u128(*this) ^ s) >> nbits) ^ s);
+        }
+        constexpr i128 operator<<(unsigned nbits) const noexcept { return i128(*this) <<= nbits; }
+        constexpr i128 operator>>(unsigned nbits) const noexcept { return i128(*this) >>= nbits; }
+
+        // bitwise
+        constexpr i128 operator~() const noexcept { return i128(~lo, ~hi); }
+        constexpr i128& operator&=(const i128& o) noexcept { lo &= o.lo; hi &= o.hi; return *this; }
+        constexpr i128& operator^=(const i128& o) noexcept { lo ^= o.lo; hi ^= o.hi; return *this; }
+        constexpr i128& operator|=(const i128& o) noexcept { lo |= o.lo; hi |= o.hi; return *this; }
+        constexpr i128 operator&(const i128& o) const noexcept { return i128(lo & o.lo, hi & o.hi); }
+        constexpr i128 operator^(const i128& o) const noexcept { return i128(lo ^ o.lo, hi ^ o.hi); }
+        constexpr i128 operator|(const i128& o) const noexcept { return i128(lo | o.lo, hi | o.hi); }
+
+        // comparison operators
+        constexpr bool operator==(const i128& o) const noexcept { return lo == o.lo && hi == o.hi; }
+        constexpr bool operator!=(const i128& o) const noexcept { return !(*this == o); }
+        constexpr bool operator<(const i128& o) const noexcept {
+            // signed compare of the hi words, unsigned of the lo words; & and | so
+            // both are computed and combined without a branch
+            return ((i64)hi < (i64)o.hi) | ((hi == o.hi) & (lo < o.lo));
+        }
+        constexpr bool operator<=(const i128& o) const noexcept { return !(o < *this); }
+        constexpr bool operator>(const i128& o) const noexcept { return o < *this; }
+        constexpr bool operator>=(const i128& o) const noexcept { return !(*this < o); }
+
+        // + - * wrap modulo 2¹²⁸
+        constexpr i128& operator+=(const i128& o) noexcept { return *this = i128(u128(*this) + u128(o)); }
+        constexpr i128& operator-=(const i128& o) noexcept { return *this = i128(u128(*this) - u128(o)); }
+        constexpr i128 operator+(const i128& o) const noexcept { return i128(*this) += o; }
+        constexpr i128 operator-(const i128& o) const noexcept { return i128(*this) -= o; }
+        constexpr i128 operator-() const noexcept { return i128(-u128(*this)); }
+        U128_CONSTEXPR i128& operator*=(const i128& o) noexcept { return *this = i128(u128(*this) * u128(o)); }
+        U128_CONSTEXPR i128 operator*(const i128& o) const noexcept { return i128(*this) *= o; }
+
+        // / and % truncate toward zero; the remainder has the sign of the dividend.
+        // Division by zero, and MIN / -1, are undefined, as for the built in types.
+        U128_CONSTEXPR i128 operator/(const i128& o) const noexcept {
+            u128 rem;
+            const u128 q = divmod(magnitude(), o.magnitude(), rem);
+            const u128 s = sign_mask() ^ o.sign_mask();
+            return i128((q ^ s) - s);
+        }
+        U128_CONSTEXPR i128 operator%(const i128& o) const noexcept {
+            u128 rem;
+            divmod(magnitude(), o.magnitude(), rem);
+            const u128 s = sign_mask();
+            return i128((rem ^ s) - s);
+        }
+        U128_CONSTEXPR i128& operator/=(const i128& o) noexcept { return *this = *this / o; }
+        U128_CONSTEXPR i128& operator%=(const i128& o) noexcept { return *this = *this % o; }
+
+        // |x| as a u128, which is exact for every value including MIN
+        constexpr u128 magnitude() const noexcept {
+            const u128 s = sign_mask();
+            return (u128(*this) ^ s) - s;
+        }
+
+        // printing functions
+
+        std::string to_string() const {
+            // decimal with a leading '-' if negative; at most 40 characters
+            return is_negative() ? "-" + magnitude().to_string() : magnitude().to_string();
+        }
+        std::string to_string_hex() const {
+            // the two's complement bits, as u128::to_string_hex
+            return u128(*this).to_string_hex();
+        }
+        friend std::ostream& operator<<(std::ostream& os, const i128& v) {
+            return os << u128(v);
+        }
+    };
+
+    static constexpr i128 I128_MIN{ 0, 0x8000000000000000ULL };
+    static constexpr i128 I128_MAX{ UINT64_MAX, 0x7fffffffffffffffULL };
+
+    // |x|, wrapping for I128_MIN as std::abs would; see i128::magnitude for
+    // the exact value as a u128.
+    inline constexpr i128 abs(const i128& x) noexcept {
+        return i128(x.magnitude());
+    }
+
+    // Returns the 128 bit product of two signed 64 bit integers. Uses
+    // intrinsics for performance where available.
+    //
+    // Portably, this is the unsigned product with the hi word corrected: a
+    // negative a reads as a + 2⁶⁴ unsigned, adding b · 2⁶⁴, and the same for b.
+    inline U128_CONSTEXPR i128 mul64s(i64 a, i64 b) noexcept {
+        if (!U128_IS_CONSTANT_EVALUATED()) {
+#if U128_PORTABLE
+#elif defined(_MSC_VER) && defined(_M_X64)
+            i64 hi = 0;
+            const i64 lo = _mul128(a, b, &hi);
+            return i128((u64)lo, (u64)hi);
+#elif defined(__SIZEOF_INT128__)
+            const __int128 p = (__int128)a * b;
+            return i128((u64)p, (u64)((unsigned __int128)p >> 64));
+#endif
+        }
+        u128 p = mul64((u64)a, (u64)b);
+        p.hi -= ((u64)(a >> 63) & (u64)b) + ((u64)(b >> 63) & (u64)a);
+        return i128(p);
+    }
+
     // Add with carry, u64 + u64 → u128
     inline constexpr u128 add64(u64 a, u64 b) noexcept {
         u64 lo = a + b;
@@ -231,28 +868,62 @@ namespace u128 {
         return { lo, hi };
     }
 
+    // Subtract with borrow, u64 - u64 → u128 (modulo 2¹²⁸)
+    // The hi word is all ones when a borrow occurred, and zero otherwise.
+    inline constexpr u128 sub64(u64 a, u64 b) noexcept {
+#if defined(_MSC_VER) && defined(_M_X64) && !U128_PORTABLE
+        if (!U128_IS_CONSTANT_EVALUATED()) {
+            u64 lo = 0;
+            const unsigned char borrow = subborrow64(0, a, b, lo);
+            return { lo, 0 - (u64)borrow };
+        }
+#endif
+        u64 lo = a - b;
+        u64 hi = (a < b) ? UINT64_MAX : 0;
+        return { lo, hi };
+    }
+
 
     // Returns a 128 bit product of two 64 bit unsigned integers. Uses
     // intrinsics for performance where available.
     // u64 * u64 → u128
-    // Note: Cannot be constexpr because _umul128 is not constexpr
-    inline u128 mul64(u64 a, u64 b) noexcept {
+    // Note: constexpr only where U128_CONSTEXPR is, because _umul128 is not constexpr
+    inline U128_CONSTEXPR u128 mul64(u64 a, u64 b) noexcept {
+        if (U128_IS_CONSTANT_EVALUATED())
+            return mul64_portable(a, b);
 
-#if defined(_MSC_VER)
-        u64 lo, hi;
-        lo = _umul128(a, b, &hi);
+#if U128_PORTABLE
+        return mul64_portable(a, b);
+
+#elif defined(_MSC_VER)
+        u64 hi = 0;
+        const u64 lo = _umul128(a, b, &hi);
         return { lo, hi };
 
 #elif defined(__SIZEOF_INT128__)
         // Use GCC/Clang 128 bit integer type
         unsigned __int128 prod = (unsigned __int128)a * (unsigned __int128)b;
-        return { (u64)prod, prod >> 64 };
+        return { (u64)prod, (u64)(prod >> 64) };
 
 #else
         return mul64_portable(a, b);
 #endif
     }
 
+    // The implementation mul64 uses at run time: "_umul128", "__int128" or
+    // "portable".
+    inline constexpr const char* mul64_path() noexcept {
+#if U128_PORTABLE
+        return "portable";
+#elif defined(_MSC_VER)
+        return "_umul128";
+#elif defined(__SIZEOF_INT128__)
+        return "__int128";
+#else
+        return "portable";
+#endif
+    }
+
 
     // 128-bit product of two 64-bit unsigned integers, done portably
     // using only 64-bit arithmetic (no __int128 or compiler intrinsics).
@@ -327,95 +998,3340 @@ namespace u128 {
 
 
 
-#if EnablePortableMultiplyVerification
+    // Number of leading zero bits in x, done portably. Returns 64 for x == 0.
+    inline constexpr int countl_zero64_portable(u64 x) noexcept {
+        if (x == 0) return 64;
+        int n = 0;
+        if ((x >> 32) == 0) { n += 32; x <<= 32; }
+        if ((x >> 48) == 0) { n += 16; x <<= 16; }
+        if ((x >> 56) == 0) { n += 8;  x <<= 8; }
+        if ((x >> 60) == 0) { n += 4;  x <<= 4; }
+        if ((x >> 62) == 0) { n += 2;  x <<= 2; }
+        if ((x >> 63) == 0) { n += 1; }
+        return n;
+    }
 
-    // -----------------------------------------------------------------------------
-    // Compare our portable multiplication result to the compiler intrinsic version.
-    // -----------------------------------------------------------------------------
-    //
-    // Returns true if both 128-bit results match; otherwise prints diagnostics.
-    //
-    // _umul128(a,b,&hi) is a MSVC intrinsic that computes the full 128-bit
-    // unsigned product of a and b. It stores the upper 64 bits into *hi and
-    // returns the lower 64 bits.
-    //
-    // The test confirms that our portable version produces *identical* lo and hi
-    // values for a large set of random and edge-case inputs.
-    //
-    bool test_product(u64 a, u64 b, bool mute = false) {
-        // Compute product using our portable implementation
-        u128 prod = mul64_portable(a, b);
+    // Number of leading zero bits in x. Returns 64 for x == 0.
+    // Uses intrinsics for performance where available.
+    inline U128_CONSTEXPR int countl_zero64(u64 x) noexcept {
+        if (U128_IS_CONSTANT_EVALUATED())
+            return countl_zero64_portable(x);
 
-        // Compute reference product using hardware intrinsic
-        u64 hi;                      // must be declared *before* calling
-        u64 lo = _umul128(a, b, &hi); // returns low 64 bits, sets high 64 bits
+#if defined(_MSC_VER) && defined(_M_X64)
+        unsigned long index = 0;
+        return _BitScanReverse64(&index, x) ? 63 - (int)index : 64;
 
-        // Optionally print detailed comparison
-        if (!mute) {
-            std::cout << a << " * " << b << "\n";
-            std::cout << "prod = { " << prod.lo << ", " << prod.hi << " }\n";
-            std::cout << "ref  = { " << lo << ", " << hi << " }\n";
-            std::cout << (lo == prod.lo && hi == prod.hi ?
-                "*** SUCCESS ***\n\n" :
-                "*** FAIL ***\n\n");
-        }
+#elif defined(__GNUC__)
+        return x == 0 ? 64 : __builtin_clzll(x);
 
-        // Return true if all 128 bits match exactly
-        return (lo == prod.lo && hi == prod.hi);
+#else
+        return countl_zero64_portable(x);
+#endif
     }
 
-    // -----------------------------------------------------------------------------
-    // Bulk test driver — runs thousands of random and deterministic test cases
-    // to ensure our 64×64→128 multiply matches the hardware intrinsic exactly.
-    // -----------------------------------------------------------------------------
-    bool test_product() {
-        int failures = 0;
+    // Number of trailing zero bits in x, done portably. Returns 64 for x == 0.
+    inline constexpr int countr_zero64_portable(u64 x) noexcept {
+        if (x == 0) return 64;
+        int n = 0;
+        if ((x & 0xFFFFFFFFULL) == 0) { n += 32; x >>= 32; }
+        if ((x & 0xFFFFULL) == 0) { n += 16; x >>= 16; }
+        if ((x & 0xFFULL) == 0) { n += 8;  x >>= 8; }
+        if ((x & 0xFULL) == 0) { n += 4;  x >>= 4; }
+        if ((x & 0x3ULL) == 0) { n += 2;  x >>= 2; }
+        if ((x & 0x1ULL) == 0) { n += 1; }
+        return n;
+    }
 
-        // Use std::random_device to generate non-deterministic 64-bit inputs
-        std::random_device rd;
-        for (int i = 0; i < 10000; i++) {
-            // Combine two 32-bit random values to form a full 64-bit number
-            u64 a = rd() | (static_cast<u64>(rd()) << 32);
-            u64 b = rd() | (static_cast<u64>(rd()) << 32);
+    // Number of trailing zero bits in x. Returns 64 for x == 0.
+    // Uses intrinsics for performance where available.
+    inline U128_CONSTEXPR int countr_zero64(u64 x) noexcept {
+        if (U128_IS_CONSTANT_EVALUATED())
+            return countr_zero64_portable(x);
 
-            // Accumulate any mismatches
-            failures += (test_product(a, b, true) ? 0 : 1);
-        }
+#if defined(_MSC_VER) && defined(_M_X64)
+        unsigned long index = 0;
+        return _BitScanForward64(&index, x) ? (int)index : 64;
 
-        // -------------------------------------------------------------------------
-        // Deterministic corner cases to check boundaries and carries:
-        // -------------------------------------------------------------------------
-        failures += (test_product(0, 0) ? 0 : 1);                       // zero × zero
-        failures += (test_product(1, 1) ? 0 : 1);                       // small × small
-        failures += (test_product(1, UINT64_MAX) ? 0 : 1);              // 1 × max
-        failures += (test_product(UINT64_MAX, 1) ? 0 : 1);              // max × 1
-        failures += (test_product(UINT64_MAX, UINT64_MAX) ? 0 : 1);     // max × max (full carry propagation)
-        failures += (test_product(0x100000001ULL, 0x100000001ULL) ? 0 : 1); // cross-boundary pattern (2^32+1)^2
-        failures += (test_product(0xFFFFFFFFFFFFFFFEULL, 0xFFFFFFFFFFFFFFFDULL) ? 0 : 1);
-        failures += (test_product(0xFFFFFFFFFFFFFFFDULL, 0xFFFFFFFFFFFFFFFEULL) ? 0 : 1);
+#elif defined(__GNUC__)
+        return x == 0 ? 64 : __builtin_ctzll(x);
 
-        // Print final test summary
-        std::cout << "N Failures = " << failures << "\n";
+#else
+        return countr_zero64_portable(x);
+#endif
+    }
 
-        // Return true if any failures occurred (for test frameworks)
-        return (failures > 0);
+    // Number of set bits in x, done portably (SWAR bit counting).
+    inline constexpr int popcount64_portable(u64 x) noexcept {
+        x = x - ((x >> 1) & 0x5555555555555555ULL);
+        x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+        x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+        return (int)((x * 0x0101010101010101ULL) >> 56);
     }
-#endif
 
+    // Number of set bits in x.
+    // Uses intrinsics for performance where available.
+    inline U128_CONSTEXPR int popcount64(u64 x) noexcept {
+        if (U128_IS_CONSTANT_EVALUATED())
+            return popcount64_portable(x);
 
-} // namespace U128
+#if defined(_MSC_VER) && defined(_M_X64) && defined(__AVX__)
+        // __popcnt64 does not check for the popcnt instruction, so only use it
+        // when the target ISA (/arch:AVX or later) guarantees it.
+        return (int)__popcnt64(x);
+
+#elif defined(__GNUC__)
+        return __builtin_popcountll(x);
+
+#else
+        return popcount64_portable(x);
+#endif
+    }
+
+
+    // -----------------------------------------------------------------------------
+    // Bit operations, mirroring C++20 <bit>
+    // -----------------------------------------------------------------------------
+
+    // Number of leading zero bits. Returns 128 for x == 0.
+    inline U128_CONSTEXPR int countl_zero(const u128& x) noexcept {
+        return x.hi ? countl_zero64(x.hi) : 64 + countl_zero64(x.lo);
+    }
+
+    // Number of trailing zero bits. Returns 128 for x == 0.
+    inline U128_CONSTEXPR int countr_zero(const u128& x) noexcept {
+        return x.lo ? countr_zero64(x.lo) : 64 + countr_zero64(x.hi);
+    }
+
+    // Number of leading one bits.
+    inline U128_CONSTEXPR int countl_one(const u128& x) noexcept {
+        return countl_zero(~x);
+    }
+
+    // Number of trailing one bits.
+    inline U128_CONSTEXPR int countr_one(const u128& x) noexcept {
+        return countr_zero(~x);
+    }
+
+    // Number of set bits.
+    inline U128_CONSTEXPR int popcount(const u128& x) noexcept {
+        return popcount64(x.lo) + popcount64(x.hi);
+    }
+
+    // Number of bits needed to represent x, i.e. 1 + floor(log2(x)), or 0 for x == 0.
+    inline U128_CONSTEXPR int bit_width(const u128& x) noexcept {
+        return 128 - countl_zero(x);
+    }
+
+    // True if x is a power of two.
+    inline constexpr bool has_single_bit(const u128& x) noexcept {
+        return x != ZERO && (x & (x - ONE)) == ZERO;
+    }
+
+    // Funnel shift left: the upper 128 bits of the 256 bit value hi:lo shifted left
+    // by n, i.e. (hi << n) | (lo >> (128 - n)). Like the x86 shld instruction, only
+    // the low 7 bits of n are used. Branch free.
+    inline constexpr u128 shld128(const u128& hi, const u128& lo, unsigned n) noexcept {
+        n &= 127;
+        return (hi << n) | ((lo >> 1) >> (127 - n));
+    }
+
+    // Funnel shift right: the lower 128 bits of the 256 bit value hi:lo shifted
+    // right by n, i.e. (lo >> n) | (hi << (128 - n)). Like the x86 shrd instruction,
+    // only the low 7 bits of n are used. Branch free. Useful for extracting a
+    // 128 bit window that starts n bits into a stream of 128 bit words.
+    inline constexpr u128 shrd128(const u128& hi, const u128& lo, unsigned n) noexcept {
+        n &= 127;
+        return (lo >> n) | ((hi << 1) << (127 - n));
+    }
+
+    // Rotate left by s bits. Negative s rotates right, as with std::rotl.
+    inline constexpr u128 rotl(const u128& x, int s) noexcept {
+        const unsigned r = (unsigned)s & 127;
+        return (x << r) | (x >> (128 - r));      // x >> 128 is zero, so r == 0 is fine
+    }
+
+    // Rotate right by s bits. Negative s rotates left, as with std::rotr.
+    inline constexpr u128 rotr(const u128& x, int s) noexcept {
+        const unsigned r = (unsigned)s & 127;
+        return (x >> r) | (x << (128 - r));
+    }
+
+
+    // -----------------------------------------------------------------------------
+    // Floating point conversion
+    // -----------------------------------------------------------------------------
+
+    // Returns x rounded to the nearest double, ties to even (the same result as
+    // converting an unsigned __int128).
+    //
+    // hi · 2⁶⁴ + lo in doubles would round twice, once per conversion of hi
+    // and lo and again in the add. Instead, shift the leading one bit to the
+    // top and keep 63 bits plus a sticky bit that is set if anything below
+    // them is; a single int64 → double conversion then rounds exactly as the
+    // whole value would, and the final scaling by a power of two is exact.
+    inline U128_CONSTEXPR double to_double(const u128& x) noexcept {
+        if (x.hi == 0)
+            return static_cast<double>(x.lo);
+        const int n = countl_zero64(x.hi);
+        const u128 y = x << n;
+        // Positive as an int64, which converts in one instruction on x86-64
+        // (a u64 with the top bit set needs several).
+        const u64 m = (y.hi >> 1) | (y.hi & 1) | (y.lo != 0);
+        return static_cast<double>(static_cast<int64_t>(m)) * static_cast<double>(u64(1) << (63 - n)) * 4.0;
+    }
+
+    // Returns d truncated toward zero, as a cast to an integer type does. NaN and
+    // values below 1 (including negative ones) give 0, and values of 2¹²⁸ or more
+    // give MAX, where such a cast would be undefined.
+    //
+    // Both steps are exact: d · 2⁻⁶⁴ only changes the exponent, and the bits of
+    // d below 2⁶⁴ fit in a double on their own.
+    inline u128 from_double(double d) noexcept {
+        if (!(d >= 1.0))
+            return u128();
+        if (d >= 0x1p128)
+            return u128(UINT64_MAX, UINT64_MAX);
+        const u64 hi = static_cast<u64>(d * 0x1p-64);
+        return u128(static_cast<u64>(d - static_cast<double>(hi) * 0x1p64), hi);
+    }
+
+    // Returns x rounded to the nearest long double, ties to even.
+    //
+    // Where long double has a 64 bit significand or more (x87 extended, IEEE
+    // quad), hi · 2⁶⁴ is exact and the add is the only rounding. Where it is
+    // just double (MSVC, most ARM targets), this is to_double.
+    inline long double to_long_double(const u128& x) noexcept {
+#if LDBL_MANT_DIG >= 64
+        return static_cast<long double>(x.hi) * 0x1p64L + static_cast<long double>(x.lo);
+#else
+        return to_double(x);
+#endif
+    }
+
+    // Returns d truncated toward zero, with the same handling of NaN and out of
+    // range values as from_double.
+    inline u128 from_long_double(long double d) noexcept {
+        if (!(d >= 1.0L))
+            return u128();
+        if (d >= 0x1p128L)
+            return u128(UINT64_MAX, UINT64_MAX);
+        const u64 hi = static_cast<u64>(d * 0x1p-64L);
+        return u128(static_cast<u64>(d - static_cast<long double>(hi) * 0x1p64L), hi);
+    }
+
+
+    // 128 / 64 → 64 bit division, done portably using only 64-bit arithmetic.
+    // Divides hi:lo by d, stores the remainder in rem and returns the quotient.
+    //
+    // Requires hi < d, so that the quotient fits in 64 bits (this is the same
+    // precondition the x86-64 div instruction has).
+    //
+    // This is Knuth's Algorithm D specialised to a two-digit divisor in base 2³²
+    // (Hacker's Delight, divlu): normalize d so its top bit is set, then estimate
+    // each 32-bit quotient digit from the top digits and correct it at most twice.
+    inline constexpr u64 div128by64_portable(u64 hi, u64 lo, u64 d, u64& rem) noexcept {
+        constexpr u64 b = 1ULL << 32;
+
+        // Normalize: shift d left until its top bit is set, and hi:lo with it.
+        const int s = countl_zero64_portable(d);
+        d <<= s;
+        const u64 dn1 = d >> 32;            // divisor digits
+        const u64 dn0 = d & 0xFFFFFFFFULL;
+        const u64 un32 = s ? (hi << s) | (lo >> (64 - s)) : hi;
+        const u64 un10 = lo << s;
+        const u64 un1 = un10 >> 32;         // lower two dividend digits
+        const u64 un0 = un10 & 0xFFFFFFFFULL;
+
+        // First quotient digit
+        u64 q1 = un32 / dn1;
+        u64 rhat = un32 - q1 * dn1;
+        while (q1 >= b || q1 * dn0 > b * rhat + un1) {
+            q1--;
+            rhat += dn1;
+            if (rhat >= b) break;
+        }
+        const u64 un21 = un32 * b + un1 - q1 * d;
+
+        // Second quotient digit
+        u64 q0 = un21 / dn1;
+        rhat = un21 - q0 * dn1;
+        while (q0 >= b || q0 * dn0 > b * rhat + un0) {
+            q0--;
+            rhat += dn1;
+            if (rhat >= b) break;
+        }
+
+        rem = (un21 * b + un0 - q0 * d) >> s;
+        return q1 * b + q0;
+    }
+
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(_MSC_VER)
+    // 128 / 64 → 64 bit division with a single divq. Requires hi < d.
+    // Neither GCC nor Clang will emit a bare divq for an __int128 dividend, since
+    // they cannot prove hi < d; they call __udivti3 instead. Say it directly.
+    // Kept out of div128by64 because asm cannot appear in a C++17 constexpr function.
+    inline u64 div128by64_divq(u64 hi, u64 lo, u64 d, u64& rem) noexcept {
+        u64 q, r;
+        __asm__("divq %[d]" : "=a"(q), "=d"(r) : [d] "r"(d), "a"(lo), "d"(hi));
+        rem = r;
+        return q;
+    }
+#endif
+
+    // 128 / 64 → 64 bit division. Divides hi:lo by d, stores the remainder
+    // in rem and returns the quotient. Requires hi < d.
+    // Uses a single hardware divide where available.
+    inline U128_CONSTEXPR u64 div128by64(u64 hi, u64 lo, u64 d, u64& rem) noexcept {
+        assert(hi < d);
+        if (U128_IS_CONSTANT_EVALUATED())
+            return div128by64_portable(hi, lo, d, rem);
+
+#if U128_PORTABLE
+        return div128by64_portable(hi, lo, d, rem);
+
+#elif defined(_MSC_VER) && _MSC_VER >= 1920 && defined(_M_X64) && !defined(__clang__)
+        return _udiv128(hi, lo, d, &rem);
+
+#elif defined(__GNUC__) && defined(__x86_64__) && !defined(_MSC_VER)
+        return div128by64_divq(hi, lo, d, rem);
+
+#elif defined(__SIZEOF_INT128__)
+        const unsigned __int128 n = ((unsigned __int128)hi << 64) | lo;
+        rem = (u64)(n % d);
+        return (u64)(n / d);
+
+#else
+        return div128by64_portable(hi, lo, d, rem);
+#endif
+    }
+
+    // u128 / u64 → u128 quotient and u64 remainder.
+    inline U128_CONSTEXPR u128 divmod(const u128& a, u64 b, u64& rem) noexcept {
+        if (a.hi < b)
+            return u128(div128by64(a.hi, a.lo, b, rem));            // one divide
+
+        // Quotient needs more than 64 bits: divide the top word first, then
+        // feed its remainder (which is < b) into a 128 / 64 divide.
+        const u64 q_hi = a.hi / b;
+        const u64 q_lo = div128by64(a.hi % b, a.lo, b, rem);
+        return { q_lo, q_hi };
+    }
+
+    // u128 / u128 → u128 quotient and u128 remainder.
+    inline U128_CONSTEXPR u128 divmod(const u128& a, const u128& b, u128& rem) noexcept {
+        if (b.hi == 0) {
+            u64 r = 0;
+            u128 q = divmod(a, b.lo, r);
+            rem = u128(r);
+            return q;
+        }
+        if (a < b) {
+            rem = a;
+            return ZERO;
+        }
+
+        // b ≥ 2⁶⁴, so the quotient fits in 64 bits. Normalize b so its top bit is
+        // set, divide the top of a (pre-shifted right by one so that the 128/64
+        // precondition holds) by the top word of b, and scale back. The estimate
+        // is at most one too large or one too small (Hacker's Delight, divlu2).
+        const int s = countl_zero64(b.hi);
+        const u64 b1 = (b << s).hi;
+        const u128 a1 = a >> 1;
+        u64 unused = 0;
+        u64 q = div128by64(a1.hi, a1.lo, b1, unused);
+        q >>= (63 - s);
+        if (q != 0)
+            q--;
+
+        // r = a - q*b. q*b < 2¹²⁸ since q ≤ a/b.
+        u128 r = a - b * q;
+        if (!(r < b)) {
+            q++;
+            r -= b;
+        }
+        rem = r;
+        return u128(q);
+    }
+
+
+    // Add with carry in and carry out, u64 + u64 + carry → u64, done portably.
+    // Stores the sum in out and returns the carry (0 or 1).
+    inline constexpr unsigned char addcarry64_portable(unsigned char carry, u64 a, u64 b, u64& out) noexcept {
+        const u64 t = a + carry;
+        out = t + b;
+        return (unsigned char)((t < a) | (out < b));
+    }
+
+    // Add with carry in and carry out, u64 + u64 + carry → u64. Stores the sum in
+    // out and returns the carry (0 or 1). Uses intrinsics where available so that
+    // chains of calls compile to a single add/adc sequence.
+    inline U128_CONSTEXPR unsigned char addcarry64(unsigned char carry, u64 a, u64 b, u64& out) noexcept {
+        if (U128_IS_CONSTANT_EVALUATED())
+            return addcarry64_portable(carry, a, b, out);
+
+#if U128_PORTABLE
+        return addcarry64_portable(carry, a, b, out);
+
+#elif (defined(_MSC_VER) && defined(_M_X64)) || (defined(__GNUC__) && defined(__x86_64__))
+        // GCC before 14 has no __builtin_addcll, but chains _addcarry_u64 into adc
+        unsigned long long sum = 0;
+        carry = _addcarry_u64(carry, a, b, &sum);
+        out = sum;
+        return carry;
+
+#elif defined(__has_builtin)
+#if __has_builtin(__builtin_addcll)
+        unsigned long long c = 0;
+        out = __builtin_addcll(a, b, carry, &c);
+        return (unsigned char)c;
+#else
+        return addcarry64_portable(carry, a, b, out);
+#endif
+
+#else
+        return addcarry64_portable(carry, a, b, out);
+#endif
+    }
+
+    // Subtract with borrow in and borrow out, u64 - u64 - borrow → u64, done
+    // portably. Stores the difference in out and returns the borrow (0 or 1).
+    inline constexpr unsigned char subborrow64_portable(unsigned char borrow, u64 a, u64 b, u64& out) noexcept {
+        const u64 t = a - b;
+        out = t - borrow;
+        return (unsigned char)((a < b) | (t < borrow));
+    }
+
+    // Subtract with borrow in and borrow out, u64 - u64 - borrow → u64, as
+    // addcarry64: chains of calls compile to a single sub/sbb sequence.
+    inline U128_CONSTEXPR unsigned char subborrow64(unsigned char borrow, u64 a, u64 b, u64& out) noexcept {
+        if (U128_IS_CONSTANT_EVALUATED())
+            return subborrow64_portable(borrow, a, b, out);
+
+#if U128_PORTABLE
+        return subborrow64_portable(borrow, a, b, out);
+
+#elif (defined(_MSC_VER) && defined(_M_X64)) || (defined(__GNUC__) && defined(__x86_64__))
+        unsigned long long diff = 0;
+        borrow = _subborrow_u64(borrow, a, b, &diff);
+        out = diff;
+        return borrow;
+
+#elif defined(__has_builtin)
+#if __has_builtin(__builtin_subcll)
+        unsigned long long c = 0;
+        out = __builtin_subcll(a, b, borrow, &c);
+        return (unsigned char)c;
+#else
+        return subborrow64_portable(borrow, a, b, out);
+#endif
+
+#else
+        return subborrow64_portable(borrow, a, b, out);
+#endif
+    }
+
+    // Returns the full 256 bit product of two 128 bit unsigned integers.
+    // u128 * u128 → u256
+    inline U128_CONSTEXPR u256 mul128(const u128& a, const u128& b) noexcept {
+        // a = a1:a0, b = b1:b0  (each half is 64 bits)
+        const u128 p00 = mul64(a.lo, b.lo);
+        const u128 p01 = mul64(a.lo, b.hi);
+        const u128 p10 = mul64(a.hi, b.lo);
+        const u128 p11 = mul64(a.hi, b.hi);
+
+        // The product is (p11 << 128) + ((p01 + p10) << 64) + p00. The two cross
+        // terms are folded in by two independent carry chains, which lets targets
+        // with ADX run them in parallel on adcx/adox.
+        u256 r;
+        r.limb[0] = p00.lo;
+        unsigned char c = addcarry64(0, p00.hi, p01.lo, r.limb[1]);
+        c = addcarry64(c, p01.hi, p11.lo, r.limb[2]);
+        r.limb[3] = p11.hi + c;                      // cannot overflow
+
+        c = addcarry64(0, r.limb[1], p10.lo, r.limb[1]);
+        c = addcarry64(c, r.limb[2], p10.hi, r.limb[2]);
+        r.limb[3] += c;                              // cannot overflow
+        return r;
+    }
+
+
+    // Returns the upper 64 bits of the 128 bit product of two 64 bit unsigned
+    // integers. Uses intrinsics for performance where available; with BMI2 this
+    // is a single mulx with the low half discarded.
+    inline U128_CONSTEXPR u64 mulhi64(u64 a, u64 b) noexcept {
+        if (U128_IS_CONSTANT_EVALUATED())
+            return mul64_portable(a, b).hi;
+
+#if U128_PORTABLE
+        return mul64_portable(a, b).hi;
+
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+        return __umulh(a, b);
+
+#elif defined(__SIZEOF_INT128__)
+        return (u64)(((unsigned __int128)a * (unsigned __int128)b) >> 64);
+
+#else
+        return mul64_portable(a, b).hi;
+#endif
+    }
+
+    // Returns the upper 128 bits of the 256 bit product of two 128 bit unsigned
+    // integers, i.e. mul128(a, b).hi(), without storing the lower half.
+    inline U128_CONSTEXPR u128 mulhi(const u128& a, const u128& b) noexcept {
+        // Same carry chains as mul128(), but of the lowest partial product only
+        // the high word is needed, and of limb 1 only the carries out of it.
+        const u64  p00_hi = mulhi64(a.lo, b.lo);
+        const u128 p01 = mul64(a.lo, b.hi);
+        const u128 p10 = mul64(a.hi, b.lo);
+        const u128 p11 = mul64(a.hi, b.hi);
+
+        u64 mid = 0, r2 = 0;
+        unsigned char c = addcarry64(0, p00_hi, p01.lo, mid);
+        c = addcarry64(c, p01.hi, p11.lo, r2);
+        u64 r3 = p11.hi + c;                         // cannot overflow
+
+        c = addcarry64(0, mid, p10.lo, mid);
+        c = addcarry64(c, r2, p10.hi, r2);
+        r3 += c;                                     // cannot overflow
+        return { r2, r3 };
+    }
+
+
+    // -----------------------------------------------------------------------------
+    // Fixed width integers: wide multiply, division and bit counts
+    // -----------------------------------------------------------------------------
+
+    // Returns the full 2·L limb product of two L limb integers.
+    template<size_t L>
+    inline U128_CONSTEXPR basic_uint<2 * L> mul_wide(const basic_uint<L>& a, const basic_uint<L>& b) noexcept {
+        basic_uint<2 * L> r;
+        unroll<L>([&](auto i) {
+            u64 carry = 0;
+            unroll<L>([&](auto j) {
+                const u128 t = mul64(a.limb[i], b.limb[j]) + r.limb[i + j] + carry;
+                r.limb[i + j] = t.lo;
+                carry = t.hi;
+            });
+            r.limb[i + L] = carry;
+        });
+        return r;
+    }
+
+    // The same for u128, so generic code can call mul_wide on any uint_n.
+    inline U128_CONSTEXPR u256 mul_wide(const u128& a, const u128& b) noexcept {
+        return mul128(a, b);
+    }
+
+    // Divides a by a 64 bit b != 0: one 128 / 64 divide per limb, carrying the
+    // remainder down.
+    template<size_t L>
+    inline U128_CONSTEXPR basic_uint<L> divmod(const basic_uint<L>& a, u64 b, u64& rem) noexcept {
+        basic_uint<L> q;
+        u64 r = 0;
+        for (size_t i = L; i-- > 0;)
+            q.limb[i] = div128by64(r, a.limb[i], b, r);
+        rem = r;
+        return q;
+    }
+
+    // Divides a by b != 0, storing the remainder in rem and returning the quotient.
+    //
+    // Knuth's Algorithm D with 64 bit digits: normalize so the divisor's top
+    // digit has its top bit set, then estimate each quotient digit from the top
+    // two remainder digits, correct it with the next divisor digit, and
+    // multiply-subtract. The corrected estimate is exact for a two digit
+    // divisor; with more digits it can still be one too large, in which case
+    // the subtraction goes negative and the divisor is added back.
+    template<size_t L>
+    inline U128_CONSTEXPR basic_uint<L> divmod(const basic_uint<L>& a, const basic_uint<L>& b, basic_uint<L>& rem) noexcept {
+        size_t n = L;                    // significant digits of b
+        while (n > 1 && b.limb[n - 1] == 0)
+            n--;
+        if (n == 1) {
+            u64 r = 0;
+            const basic_uint<L> q = divmod(a, b.limb[0], r);
+            rem = basic_uint<L>(r);
+            return q;
+        }
+        basic_uint<L> q;
+        if (a < b) {
+            rem = a;
+            return q;
+        }
+
+        const int s = countl_zero64(b.limb[n - 1]);
+        u64 v[L] = {};
+        u64 u[L + 1] = {};
+        for (size_t i = 0; i < n; i++)
+            v[i] = (b.limb[i] << s) | (i > 0 && s ? b.limb[i - 1] >> (64 - s) : 0);
+        u[L] = s ? a.limb[L - 1] >> (64 - s) : 0;
+        for (size_t i = 0; i < L; i++)
+            u[i] = (a.limb[i] << s) | (i > 0 && s ? a.limb[i - 1] >> (64 - s) : 0);
+
+        const u64 v1 = v[n - 1], v2 = v[n - 2];
+        for (size_t j = L - n + 1; j-- > 0;) {
+            // Invariant: u[j+n..j+1] < v, so u[j+n] ≤ v1.
+            u64 qhat = 0, rhat = 0;
+            bool rhat_overflow = false;
+            if (u[j + n] == v1) {
+                qhat = UINT64_MAX;
+                rhat = u[j + n - 1] + v1;
+                rhat_overflow = rhat < v1;
+            }
+            else {
+                qhat = div128by64(u[j + n], u[j + n - 1], v1, rhat);
+            }
+            while (!rhat_overflow && mul64(qhat, v2) > u128(u[j + n - 2], rhat)) {
+                qhat--;
+                rhat += v1;
+                rhat_overflow = rhat < v1;
+            }
+
+            // u[j..j+n] -= qhat · v
+            u64 carry = 0, borrow = 0;
+            for (size_t i = 0; i < n; i++) {
+                const u128 p = mul64(qhat, v[i]) + carry;
+                carry = p.hi;
+                const u64 x = u[i + j];
+                const u64 d = x - p.lo;
+                const u64 b1 = x < p.lo;
+                u[i + j] = d - borrow;
+                borrow = b1 | (d < borrow);
+            }
+            const u64 top = carry + borrow;      // carry < 2⁶⁴ - 1, so no overflow
+            const bool negative = u[j + n] < top;
+            u[j + n] -= top;
+
+            if (negative) {
+                qhat--;
+                unsigned char c = 0;
+                for (size_t i = 0; i < n; i++)
+                    c = addcarry64(c, u[i + j], v[i], u[i + j]);
+                u[j + n] += c;
+            }
+            q.limb[j] = qhat;
+        }
+
+        rem = basic_uint<L>();
+        for (size_t i = 0; i < n; i++)
+            rem.limb[i] = (u[i] >> s) | (s ? u[i + 1] << (64 - s) : 0);
+        return q;
+    }
+
+    // Bit counts, as for u128.
+    template<size_t L>
+    inline U128_CONSTEXPR int countl_zero(const basic_uint<L>& x) noexcept {
+        int n = 0;
+        bool done = false;
+        for (size_t i = L; i-- > 0;) {
+            const int c = countl_zero64(x.limb[i]);
+            n += done ? 0 : c;
+            done |= c != 64;
+        }
+        return n;
+    }
+    template<size_t L>
+    inline U128_CONSTEXPR int countr_zero(const basic_uint<L>& x) noexcept {
+        int n = 0;
+        bool done = false;
+        unroll<L>([&](auto i) {
+            const int c = countr_zero64(x.limb[i]);
+            n += done ? 0 : c;
+            done |= c != 64;
+        });
+        return n;
+    }
+    template<size_t L>
+    inline U128_CONSTEXPR int popcount(const basic_uint<L>& x) noexcept {
+        int n = 0;
+        unroll<L>([&](auto i) { n += popcount64(x.limb[i]); });
+        return n;
+    }
+    template<size_t L>
+    inline U128_CONSTEXPR int bit_width(const basic_uint<L>& x) noexcept {
+        return 64 * (int)L - countl_zero(x);
+    }
+
+
+    // -----------------------------------------------------------------------------
+    // Fused multiply-add and accumulation
+    // -----------------------------------------------------------------------------
+
+    // acc += a * b (mod 2¹²⁸). Returns the carry out of bit 127, so that callers
+    // building wider numbers can propagate it. One mul plus an add/adc pair.
+    inline U128_CONSTEXPR unsigned char mac64(u128& acc, u64 a, u64 b) noexcept {
+        const u128 p = mul64(a, b);
+        const unsigned char c = addcarry64(0, acc.lo, p.lo, acc.lo);
+        return addcarry64(c, acc.hi, p.hi, acc.hi);
+    }
+
+    // a * b + c (mod 2¹²⁸), for a u64 multiplier
+    inline U128_CONSTEXPR u128 fma(const u128& a, u64 b, const u128& c) noexcept {
+        u128 r = mul64(a.lo, b);
+        r.hi += a.hi * b;                            // upper bits of a.hi·b are discarded
+        return r + c;
+    }
+
+    // carry_save_accumulator: exact sum of up to 2⁶⁴ u64·u64 products (or u64 or
+    // u128 values), for dot products, checksums and big number inner loops.
+    //
+    // The low and high halves of each product go into two separate 128 bit sums,
+    // so every add has its own short carry chain and consecutive adds do not wait
+    // on each other; the halves are only combined once, in total() or value().
+    // Independent accumulators can be merged, e.g. after an unrolled loop.
+    //
+    //      carry_save_accumulator acc;
+    //      for (size_t i = 0; i < n; i++)
+    //          acc.add(a[i], b[i]);
+    //      u128 dot = acc.value();
+    struct carry_save_accumulator {
+        u128 lo_sum;    // sum of the low words
+        u128 hi_sum;    // sum of the high words, weighted by 2⁶⁴
+
+        constexpr carry_save_accumulator() : lo_sum(), hi_sum() {}
+
+        // += a * b
+        U128_CONSTEXPR void add(u64 a, u64 b) noexcept {
+            const u128 p = mul64(a, b);
+            lo_sum += p.lo;
+            hi_sum += p.hi;
+        }
+        // += x
+        constexpr void add(u64 x) noexcept {
+            lo_sum += x;
+        }
+        constexpr void add(const u128& x) noexcept {
+            lo_sum += x.lo;
+            hi_sum += x.hi;
+        }
+        constexpr void merge(const carry_save_accumulator& other) noexcept {
+            lo_sum += other.lo_sum;
+            hi_sum += other.hi_sum;
+        }
+
+        // The exact sum, lo_sum + hi_sum · 2⁶⁴ (at most 192 bits)
+        constexpr u256 total() const noexcept {
+            const u128 mid = u128(lo_sum.hi) + hi_sum.lo;    // bits 64 .. 191, exact
+            return u256(u128(lo_sum.lo, mid.lo), u128(hi_sum.hi + mid.hi, 0));
+        }
+        // The sum mod 2¹²⁸
+        constexpr u128 value() const noexcept {
+            return lo_sum + u128(0, hi_sum.lo);
+        }
+    };
+
+
+    // -----------------------------------------------------------------------------
+    // Overflow checked and saturating arithmetic
+    // -----------------------------------------------------------------------------
+
+    // Result of a checked operation: the wrapped (mod 2¹²⁸) value, and whether the
+    // exact result did not fit.
+    struct checked_result {
+        u128 value;
+        bool overflow;
+    };
+
+    // a + b, reporting the carry out of bit 127
+    inline U128_CONSTEXPR checked_result checked_add(const u128& a, const u128& b) noexcept {
+        u128 r;
+        unsigned char c = addcarry64(0, a.lo, b.lo, r.lo);
+        c = addcarry64(c, a.hi, b.hi, r.hi);
+        return { r, c != 0 };
+    }
+
+    // a - b, reporting the borrow out of bit 127 (i.e. b > a)
+    inline constexpr checked_result checked_sub(const u128& a, const u128& b) noexcept {
+        return { a - b, a < b };
+    }
+
+    // a * b, reporting whether any of the bits that operator* discards are set
+    inline U128_CONSTEXPR checked_result checked_mul(const u128& a, const u128& b) noexcept {
+        // Same partial products as operator*: lo·lo in full, and the cross terms,
+        // whose upper halves would land at bit 128 and up. hi·hi is nonzero exactly
+        // when both high words are.
+        const u128 p00 = mul64(a.lo, b.lo);
+        const u128 p01 = mul64(a.lo, b.hi);
+        const u128 p10 = mul64(a.hi, b.lo);
+        u128 r(p00.lo, 0);
+        unsigned char c1 = addcarry64(0, p00.hi, p01.lo, r.hi);
+        unsigned char c2 = addcarry64(0, r.hi, p10.lo, r.hi);
+        const bool overflow = (a.hi != 0 && b.hi != 0) || p01.hi != 0 || p10.hi != 0 || (c1 | c2) != 0;
+        return { r, overflow };
+    }
+
+    // a * b for a u64 multiplier, reporting overflow
+    inline U128_CONSTEXPR checked_result checked_mul(const u128& a, u64 b) noexcept {
+        const u128 p0 = mul64(a.lo, b);
+        const u128 p1 = mul64(a.hi, b);
+        u128 r(p0.lo, 0);
+        const unsigned char c = addcarry64(0, p0.hi, p1.lo, r.hi);
+        return { r, (p1.hi != 0) || (c != 0) };
+    }
+
+    // a + b, clamped to MAX
+    inline U128_CONSTEXPR u128 saturating_add(const u128& a, const u128& b) noexcept {
+        const checked_result r = checked_add(a, b);
+        return r.overflow ? MAX : r.value;
+    }
+
+    // a - b, clamped to ZERO
+    inline constexpr u128 saturating_sub(const u128& a, const u128& b) noexcept {
+        return a < b ? ZERO : a - b;
+    }
+
+    // a * b, clamped to MAX
+    inline U128_CONSTEXPR u128 saturating_mul(const u128& a, const u128& b) noexcept {
+        const checked_result r = checked_mul(a, b);
+        return r.overflow ? MAX : r.value;
+    }
+    inline U128_CONSTEXPR u128 saturating_mul(const u128& a, u64 b) noexcept {
+        const checked_result r = checked_mul(a, b);
+        return r.overflow ? MAX : r.value;
+    }
+
+
+    // -----------------------------------------------------------------------------
+    // Division by a compile-time constant
+    // -----------------------------------------------------------------------------
+
+    // constant_divider<D>: the plan for dividing a u128 by the constant D, worked
+    // out at compile time with the portable (always constexpr) primitives. div_by
+    // and mod_by below are the intended way to use it.
+    //
+    // Three strategies, cheapest first:
+    // - D a power of two: a shift.
+    // - D = 2ᵗ · d with d odd: q = mulhi(n >> t, m) >> l with m = ⌈2¹²⁸⁺ˡ / d⌉,
+    //   for the smallest l that makes this exact for n < 2¹²⁸⁻ᵗ and leaves m in
+    //   128 bits (Granlund & Montgomery, theorem 4.2). This covers 10¹⁹ and 10⁹.
+    // - otherwise the round-up method that u128_divider uses for large divisors:
+    //   t = mulhi(m, n), q = (t + (n - t) / 2) >> (l - 1).
+    //
+    // D is a u64 since C++17 does not allow a u128 template argument.
+    template<u64 D>
+    struct constant_divider {
+        static_assert(D != 0, "division by zero");
+
+        struct plan {
+            u128 magic;
+            int pre_shift;      // applied to n before the multiply
+            int shift;          // applied after the multiply
+            bool round_up;      // use the round-up (add) method
+        };
+
+        // Quotient (up to 256 bits) and remainder of x / d, for a u64 d.
+        static constexpr u256 divide_u256(const u256& x, u64 d, u64& rem) noexcept {
+            u256 q;
+            u64 r = 0;
+            for (int i = 3; i >= 0; i--)
+                q.limb[i] = div128by64_portable(r, x.limb[i], d, r);
+            rem = r;
+            return q;
+        }
+
+        static constexpr plan make_plan() noexcept {
+            const int t = countr_zero64_portable(D);
+            if ((D & (D - 1)) == 0)
+                return { ZERO, t, 0, false };
+
+            const u64 d = D >> t;
+            for (int l = 0; l <= 64; l++) {
+                // 2¹²⁸⁺ˡ / d
+                u256 x;
+                x.limb[2 + l / 64] = 1ULL << (l % 64);
+                u64 r = 0;
+                const u256 q = divide_u256(x, d, r);
+                const u128 m = q.lo() + (u64)(r != 0);
+                if (q.hi() != ZERO || m == ZERO)
+                    break;                          // m no longer fits in 128 bits
+                // exact for n < 2¹²⁸⁻ᵗ if e = m·d - 2¹²⁸⁺ˡ ≤ 2ˡ⁺ᵗ
+                const u64 e = r ? d - r : 0;
+                if (l + t >= 64 || e <= (1ULL << (l + t)))
+                    return { m, t, l, false };
+            }
+
+            // m = ⌊2¹²⁸ (2ˡ - D) / D⌋ + 1 with l = ⌈log2 D⌉ ≤ 64
+            const int l = 64 - countl_zero64_portable(D - 1);
+            u256 x;
+            x.limb[2] = (l == 64 ? 0 : (1ULL << l)) - D;   // wraps to 2⁶⁴ - D for l = 64
+            u64 r = 0;
+            return { divide_u256(x, D, r).lo() + ONE, 0, l - 1, true };
+        }
+
+        static constexpr plan p = make_plan();
+
+        static U128_CONSTEXPR u128 divide(const u128& n) noexcept {
+            if constexpr ((D & (D - 1)) == 0) {
+                return n >> (unsigned)p.pre_shift;
+            }
+            else if constexpr (!p.round_up) {
+                return mulhi(n >> (unsigned)p.pre_shift, p.magic) >> (unsigned)p.shift;
+            }
+            else {
+                const u128 t = mulhi(p.magic, n);
+                return (t + ((n - t) >> 1)) >> (unsigned)p.shift;
+            }
+        }
+    };
+
+    // n / D for a compile-time constant D, e.g. div_by<1000000000>(ns)
+    template<u64 D>
+    inline U128_CONSTEXPR u128 div_by(const u128& n) noexcept {
+        return constant_divider<D>::divide(n);
+    }
+
+    // n % D for a compile-time constant D
+    template<u64 D>
+    inline U128_CONSTEXPR u64 mod_by(const u128& n) noexcept {
+        if constexpr ((D & (D - 1)) == 0)
+            return n.lo & (D - 1);
+        else
+            return n.lo - constant_divider<D>::divide(n).lo * D;    // exact: the remainder fits in 64 bits
+    }
+
+
+    // -----------------------------------------------------------------------------
+    // Decimal formatting
+    // -----------------------------------------------------------------------------
+
+    // 10¹⁹, the largest power of ten that fits in a u64.
+    static constexpr u64 POW10_19 = 10000000000000000000ULL;
+
+    // Pairs of decimal digits "00" .. "99", so digits can be emitted two at a time.
+    inline constexpr char DIGITS_2[201] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+
+    // Divides x by 10¹⁹ using a precomputed reciprocal instead of a division.
+    // Returns the quotient and stores the remainder (< 10¹⁹) in rem.
+    inline U128_CONSTEXPR u128 divmod_pow10_19(const u128& x, u64& rem) noexcept {
+        // 10¹⁹ = 2¹⁹ · 5¹⁹, so div_by shifts out the 2¹⁹ and multiplies by a
+        // 110 bit reciprocal of 5¹⁹: one mulhi and two shifts.
+        const u128 q = div_by<POW10_19>(x);
+        rem = x.lo - q.lo * POW10_19;               // exact: the remainder fits in 64 bits
+        return q;
+    }
+
+    // Writes the decimal digits of v so that they end just before p, and returns
+    // a pointer to the first digit. Writes at least one digit.
+    inline char* write_digits_backward(char* p, u64 v) noexcept {
+        while (v >= 100) {
+            const u64 i = (v % 100) * 2;
+            v /= 100;
+            *--p = DIGITS_2[i + 1];
+            *--p = DIGITS_2[i];
+        }
+        if (v >= 10) {
+            *--p = DIGITS_2[v * 2 + 1];
+            *--p = DIGITS_2[v * 2];
+        }
+        else {
+            *--p = (char)('0' + v);
+        }
+        return p;
+    }
+
+    // As write_digits_backward, but always writes exactly 19 digits (v < 10¹⁹),
+    // zero-padded on the left.
+    inline char* write_19_digits_backward(char* p, u64 v) noexcept {
+        for (int i = 0; i < 9; i++) {
+            const u64 j = (v % 100) * 2;
+            v /= 100;
+            *--p = DIGITS_2[j + 1];
+            *--p = DIGITS_2[j];
+        }
+        *--p = (char)('0' + v);
+        return p;
+    }
+
+    // -----------------------------------------------------------------------------
+    // Hex formatting
+    // -----------------------------------------------------------------------------
+
+    // Pairs of lowercase hex digits "00" .. "ff", so a byte can be emitted at once.
+    inline constexpr char HEX_DIGITS_2[513] =
+        "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f2021222324252627"
+        "28292a2b2c2d2e2f303132333435363738393a3b3c3d3e3f404142434445464748494a4b4c4d4e4f"
+        "505152535455565758595a5b5c5d5e5f606162636465666768696a6b6c6d6e6f7071727374757677"
+        "78797a7b7c7d7e7f808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f"
+        "a0a1a2a3a4a5a6a7a8a9aaabacadaeafb0b1b2b3b4b5b6b7b8b9babbbcbdbebfc0c1c2c3c4c5c6c7"
+        "c8c9cacbcccdcecfd0d1d2d3d4d5d6d7d8d9dadbdcdddedfe0e1e2e3e4e5e6e7e8e9eaebecedeeef"
+        "f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+    // Writes the 16 hex digits of v, zero-padded, to p. Returns p + 16.
+    inline char* write_hex_16(char* p, u64 v) noexcept {
+        for (int i = 14; i >= 0; i -= 2) {
+            const unsigned j = (unsigned)(v & 0xFF) * 2;
+            v >>= 8;
+            p[i] = HEX_DIGITS_2[j];
+            p[i + 1] = HEX_DIGITS_2[j + 1];
+        }
+        return p + 16;
+    }
+
+    // Writes the 32 hex digits of value, zero-padded and without a 0x prefix, to p.
+    // p must have room for 32 characters; no terminating null is written.
+    // Returns p + 32. This is the digit part of to_string_hex().
+    inline char* write_hex_32(char* p, const u128& value) noexcept {
+        return write_hex_16(write_hex_16(p, value.hi), value.lo);
+    }
+
+    // Writes value to [first, last) in the given base (2 to 36), with no leading
+    // zeros, no prefix and no terminating null, following the std::to_chars
+    // contract: on success returns { one past the last character written,
+    // std::errc() }; if the buffer is too small returns
+    // { last, std::errc::value_too_large } and the buffer contents are unspecified.
+    // Never allocates. Digits above 9 are lowercase. 128 characters always suffice
+    // (39 for base 10, 32 for base 16).
+    inline std::to_chars_result to_chars(char* first, char* last, const u128& value, int base) noexcept {
+        assert(base >= 2 && base <= 36);
+
+        char buf[128];
+        char* const end = buf + sizeof(buf);
+        char* p;
+        if (base == 10) {
+            // value = (top · 10¹⁹ + mid) · 10¹⁹ + low, with top ≤ 34
+            if (value.hi == 0) {
+                p = write_digits_backward(end, value.lo);
+            }
+            else {
+                u64 low = 0, mid = 0;
+                const u128 q = divmod_pow10_19(value, low);
+                p = write_19_digits_backward(end, low);
+                if (q.hi == 0 && q.lo < POW10_19) {
+                    p = write_digits_backward(p, q.lo);
+                }
+                else {
+                    const u128 top = divmod_pow10_19(q, mid);
+                    p = write_19_digits_backward(p, mid);
+                    p = write_digits_backward(p, top.lo);
+                }
+            }
+        }
+        else if (base == 16) {
+            p = write_hex_32(end - 32, value) - 32;
+            const int zeros = countl_zero(value);
+            p += (zeros == 128) ? 31 : zeros / 4;
+        }
+        else {
+            u128 v = value;
+            p = end;
+            do {
+                u64 digit = 0;
+                v = divmod(v, (u64)base, digit);
+                *--p = "0123456789abcdefghijklmnopqrstuvwxyz"[digit];
+            } while (v != ZERO);
+        }
+
+        const size_t n = (size_t)(end - p);
+        if ((size_t)(last - first) < n)
+            return { last, std::errc::value_too_large };
+        for (size_t i = 0; i < n; i++)
+            first[i] = p[i];
+        return { first + n, std::errc() };
+    }
+
+
+    // -----------------------------------------------------------------------------
+    // Parsing
+    // -----------------------------------------------------------------------------
+
+    // Loads 8 bytes from p (any alignment) as a little endian u64, i.e. p[0] ends
+    // up in the lowest byte. Compiles to a single mov on little endian targets.
+    inline u64 load64_le(const void* p) noexcept {
+        u64 v;
+        std::memcpy(&v, p, sizeof(v));
+#if U128_BIG_ENDIAN
+        v = __builtin_bswap64(v);
+#endif
+        return v;
+    }
+
+    // SWAR helpers: each byte of the u64 is one character, first character in the
+    // lowest byte (see load64_le).
+    static constexpr u64 SWAR_ONES = 0x0101010101010101ULL;
+    static constexpr u64 SWAR_HIGH = 0x8080808080808080ULL;
+
+    // High bit of each byte set where that byte is ≥ n. Requires every byte of x,
+    // and n, to be ≤ 0x80, so that no byte borrows from its neighbour.
+    inline constexpr u64 swar_bytes_ge(u64 x, unsigned n) noexcept {
+        return ((x | SWAR_HIGH) - n * SWAR_ONES) & SWAR_HIGH;
+    }
+
+    // True if all 8 characters are decimal digits.
+    inline constexpr bool swar_is_8_digits(u64 x) noexcept {
+        return ((x & 0xF0F0F0F0F0F0F0F0ULL) |
+            (((x + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) == 0x3333333333333333ULL;
+    }
+
+    // Value of 8 decimal digits, combining neighbouring digits, then pairs,
+    // then quads, with three multiplies (Lemire, simdjson).
+    inline constexpr u64 swar_parse_8_digits(u64 x) noexcept {
+        x -= 0x3030303030303030ULL;
+        x = (x * 10) + (x >> 8);
+        x = (((x & 0x000000FF000000FFULL) * 0x000F424000000064ULL) +           // 100 + (10⁶ << 32)
+            (((x >> 16) & 0x000000FF000000FFULL) * 0x0000271000000001ULL)) >> 32; // 1 + (10⁴ << 32)
+        return x;
+    }
+
+    // True if all 8 characters are hex digits (either case).
+    inline constexpr bool swar_is_8_hex_digits(u64 x) noexcept {
+        if (x & SWAR_HIGH)
+            return false;
+        const u64 y = x | 0x2020202020202020ULL;              // fold to lowercase
+        const u64 digit = swar_bytes_ge(x, '0') & ~swar_bytes_ge(x, '9' + 1);
+        const u64 alpha = swar_bytes_ge(y, 'a') & ~swar_bytes_ge(y, 'f' + 1);
+        return (digit | alpha) == SWAR_HIGH;
+    }
+
+    // Value of 8 hex digits: convert each character to its nibble, then pack
+    // neighbouring nibbles, bytes and halfwords.
+    inline constexpr u64 swar_parse_8_hex_digits(u64 x) noexcept {
+        x = (x & 0x0F0F0F0F0F0F0F0FULL) + ((x >> 6) & SWAR_ONES) * 9;   // 'a' = 0x61 → 1 + 9
+        x = ((x << 4) | (x >> 8)) & 0x00FF00FF00FF00FFULL;
+        x = ((x << 8) | (x >> 16)) & 0x0000FFFF0000FFFFULL;
+        x = ((x << 16) | (x >> 32)) & 0x00000000FFFFFFFFULL;
+        return x;
+    }
+
+    // Value of the digit c in bases up to 36, or 36 if c is not a digit.
+    inline constexpr unsigned digit_value(char c) noexcept {
+        const unsigned d = (unsigned)(unsigned char)c - '0';
+        if (d < 10) return d;
+        const unsigned l = ((unsigned)(unsigned char)c | 0x20) - 'a';
+        if (l < 26) return l + 10;
+        return 36;
+    }
+
+    // Value of n ≤ 19 decimal digits at p, which are known to be valid.
+    inline u64 parse_digits_u64(const char* p, size_t n) noexcept {
+        u64 v = 0;
+        for (; n >= 8; n -= 8, p += 8)
+            v = v * 100000000 + swar_parse_8_digits(load64_le(p));
+        for (; n > 0; n--, p++)
+            v = v * 10 + (u64)(*p - '0');
+        return v;
+    }
+
+    // Value of n ≤ 16 hex digits at p, which are known to be valid.
+    inline u64 parse_hex_digits_u64(const char* p, size_t n) noexcept {
+        u64 v = 0;
+        for (; n >= 8; n -= 8, p += 8)
+            v = (v << 32) | swar_parse_8_hex_digits(load64_le(p));
+        for (; n > 0; n--, p++)
+            v = (v << 4) | digit_value(*p);
+        return v;
+    }
+
+    // Reads exactly 32 hex digits (either case, no 0x prefix) at p into value, the
+    // inverse of write_hex_32. Returns false, leaving value unchanged, if any of
+    // the 32 characters is not a hex digit.
+    inline bool read_hex_32(const char* p, u128& value) noexcept {
+        const u64 c0 = load64_le(p), c1 = load64_le(p + 8);
+        const u64 c2 = load64_le(p + 16), c3 = load64_le(p + 24);
+        if (!(swar_is_8_hex_digits(c0) & swar_is_8_hex_digits(c1) &
+            swar_is_8_hex_digits(c2) & swar_is_8_hex_digits(c3)))
+            return false;
+        value = {
+            (swar_parse_8_hex_digits(c2) << 32) | swar_parse_8_hex_digits(c3),
+            (swar_parse_8_hex_digits(c0) << 32) | swar_parse_8_hex_digits(c1)
+        };
+        return true;
+    }
+
+    // Reads a value in the given base (2 to 36) from [first, last), following the
+    // std::from_chars contract: no whitespace, sign or 0x prefix is accepted, and
+    // letters may be either case.
+    // - on success, stores the value and returns { one past the last digit, std::errc() }
+    // - if there are no digits, returns { first, std::errc::invalid_argument }
+    // - if the value does not fit, returns { one past the last digit,
+    //   std::errc::result_out_of_range }
+    // value is left unchanged on failure. Never allocates.
+    inline std::from_chars_result from_chars(const char* first, const char* last, u128& value, int base = 10) noexcept {
+        assert(base >= 2 && base <= 36);
+
+        // Find the run of digits, and the first significant one.
+        const char* p = first;
+        if (base == 10) {
+            while (last - p >= 8 && swar_is_8_digits(load64_le(p)))
+                p += 8;
+        }
+        else if (base == 16) {
+            while (last - p >= 8 && swar_is_8_hex_digits(load64_le(p)))
+                p += 8;
+        }
+        while (p != last && digit_value(*p) < (unsigned)base)
+            p++;
+        if (p == first)
+            return { first, std::errc::invalid_argument };
+        const char* const end = p;
+        const char* digits = first;
+        while (digits != end - 1 && *digits == '0')
+            digits++;
+        const size_t n = (size_t)(end - digits);
+
+        if (base == 10) {
+            // Split into chunks of 19 digits, each of which fits in a u64:
+            // value = (top · 10¹⁹ + mid) · 10¹⁹ + low
+            if (n > 39)
+                return { end, std::errc::result_out_of_range };
+            if (n <= 19) {
+                value = u128(parse_digits_u64(digits, n));
+            }
+            else if (n <= 38) {
+                const u64 mid = parse_digits_u64(digits, n - 19);
+                value = mul64(mid, POW10_19) + parse_digits_u64(end - 19, 19);
+            }
+            else {
+                const u128 t = mul64(parse_digits_u64(digits, 1), POW10_19) + parse_digits_u64(digits + 1, 19);
+                const u128 p_lo = mul64(t.lo, POW10_19);
+                const u128 p_hi = mul64(t.hi, POW10_19);
+                u128 v(p_lo.lo, p_lo.hi + p_hi.lo);
+                const bool overflow = p_hi.hi != 0 || v.hi < p_lo.hi;
+                const u64 low = parse_digits_u64(end - 19, 19);
+                v += low;
+                if (overflow || v < u128(low))
+                    return { end, std::errc::result_out_of_range };
+                value = v;
+            }
+        }
+        else if (base == 16) {
+            if (n > 32)
+                return { end, std::errc::result_out_of_range };
+            if (n <= 16)
+                value = u128(parse_hex_digits_u64(digits, n));
+            else
+                value = u128(parse_hex_digits_u64(end - 16, 16), parse_hex_digits_u64(digits, n - 16));
+        }
+        else {
+            // value · base + d overflows exactly when value > (MAX - d) / base
+            u64 max_rem = 0;
+            const u128 max_quot = divmod(MAX, (u64)base, max_rem);
+            u128 v;
+            for (; digits != end; digits++) {
+                const unsigned d = digit_value(*digits);
+                if (v > max_quot || (v == max_quot && d > max_rem))
+                    return { end, std::errc::result_out_of_range };
+                v = v * (u64)base + d;
+            }
+            value = v;
+        }
+        return { end, std::errc() };
+    }
+
+    // Reads all of s into value, returning false (and leaving value unchanged) if
+    // s is not entirely a number in the given base. For base 16 an optional 0x or
+    // 0X prefix is accepted, so that from_string() reads back both to_string()
+    // and to_string_hex().
+    inline bool from_string(std::string_view s, u128& value, int base = 10) noexcept {
+        const char* first = s.data();
+        const char* const last = first + s.size();
+        if (base == 16 && s.size() > 2 && first[0] == '0' && (first[1] | 0x20) == 'x')
+            first += 2;
+        const std::from_chars_result r = from_chars(first, last, value, base);
+        return r.ec == std::errc() && r.ptr == last;
+    }
+
+
+    // -----------------------------------------------------------------------------
+    // Binary serialization
+    // -----------------------------------------------------------------------------
+
+    // Reverses the byte order of x. Compilers turn both forms into one bswap
+    // (or rev) instruction.
+    inline U128_CONSTEXPR u64 bswap64(u64 x) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_bswap64(x);
+#else
+#if defined(_MSC_VER)
+        if (!U128_IS_CONSTANT_EVALUATED())
+            return _byteswap_uint64(x);
+#endif
+        x = ((x & 0x00FF00FF00FF00FFULL) << 8) | ((x >> 8) & 0x00FF00FF00FF00FFULL);
+        x = ((x & 0x0000FFFF0000FFFFULL) << 16) | ((x >> 16) & 0x0000FFFF0000FFFFULL);
+        return (x << 32) | (x >> 32);
+#endif
+    }
+
+    inline U128_CONSTEXPR u128 byteswap(const u128& x) noexcept {
+        return u128(bswap64(x.hi), bswap64(x.lo));
+    }
+
+    // Counterparts of load64_le, with p[0] the highest byte for the _be forms.
+    inline u64 load64_be(const void* p) noexcept {
+        u64 v;
+        std::memcpy(&v, p, sizeof(v));
+#if !U128_BIG_ENDIAN
+        v = bswap64(v);
+#endif
+        return v;
+    }
+
+    inline void store64_le(void* p, u64 v) noexcept {
+#if U128_BIG_ENDIAN
+        v = bswap64(v);
+#endif
+        std::memcpy(p, &v, sizeof(v));
+    }
+
+    inline void store64_be(void* p, u64 v) noexcept {
+#if !U128_BIG_ENDIAN
+        v = bswap64(v);
+#endif
+        std::memcpy(p, &v, sizeof(v));
+    }
+
+    // Load and store 16 bytes at p, any alignment, in little or big endian byte
+    // order. On a little endian target the _le forms are plain 16 byte copies
+    // (u128 is lo then hi in memory), and the _be forms add two bswaps.
+    inline u128 load_le(const std::byte* p) noexcept { return u128(load64_le(p), load64_le(p + 8)); }
+    inline u128 load_be(const std::byte* p) noexcept { return u128(load64_be(p + 8), load64_be(p)); }
+    inline void store_le(std::byte* p, const u128& v) noexcept { store64_le(p, v.lo); store64_le(p + 8, v.hi); }
+    inline void store_be(std::byte* p, const u128& v) noexcept { store64_be(p, v.hi); store64_be(p + 8, v.lo); }
+
+    // The same for n values, 16 · n bytes at p. Without a byte order change this
+    // is a single memcpy.
+    inline void load_le(const std::byte* p, u128* out, size_t n) noexcept {
+#if !U128_BIG_ENDIAN
+        if (n) std::memcpy(out, p, 16 * n);
+#else
+        for (size_t i = 0; i < n; i++) out[i] = load_le(p + 16 * i);
+#endif
+    }
+    inline void store_le(std::byte* p, const u128* v, size_t n) noexcept {
+#if !U128_BIG_ENDIAN
+        if (n) std::memcpy(p, v, 16 * n);
+#else
+        for (size_t i = 0; i < n; i++) store_le(p + 16 * i, v[i]);
+#endif
+    }
+    inline void load_be(const std::byte* p, u128* out, size_t n) noexcept {
+        for (size_t i = 0; i < n; i++) out[i] = load_be(p + 16 * i);
+    }
+    inline void store_be(std::byte* p, const u128* v, size_t n) noexcept {
+        for (size_t i = 0; i < n; i++) store_be(p + 16 * i, v[i]);
+    }
+
+    // Varints: LEB128, as in protocol buffers and DWARF. Seven bits per byte,
+    // lowest first, with the top bit set on every byte but the last, so values
+    // below 2⁷ take one byte, below 2¹⁴ two, and so on up to 19 for the top of
+    // the range.
+    static constexpr size_t VARINT_MAX_BYTES = 19;
+
+    // The number of bytes write_varint(p, v) writes.
+    inline U128_CONSTEXPR size_t varint_size(const u128& v) noexcept {
+        // 7 bits of bit_width(v | 1) to a byte
+        const unsigned w = v.hi ? 128 - countl_zero64(v.hi) : 64 - countl_zero64(v.lo | 1);
+        return (w + 6) / 7;
+    }
+
+    // Writes v as a varint at p, which must have room for varint_size(v) (at
+    // most VARINT_MAX_BYTES) bytes, and returns the end of what was written.
+    inline std::byte* write_varint(std::byte* p, const u128& v) noexcept {
+        u128 x = v;
+        while (x.hi != 0) {         // only for values of 2⁶⁴ and up
+            *p++ = std::byte((x.lo & 0x7F) | 0x80);
+            x >>= 7;
+        }
+        u64 lo = x.lo;
+        while (lo >= 0x80) {
+            *p++ = std::byte((lo & 0x7F) | 0x80);
+            lo >>= 7;
+        }
+        *p++ = std::byte(lo);
+        return p;
+    }
+
+    // Reads a varint from [first, last) into value and returns the end of it, or
+    // returns nullptr (leaving value unchanged) if the input ends inside the
+    // varint or it does not fit in 128 bits. As with protocol buffers, padded
+    // encodings (0x80 0x00 for 0) are accepted.
+    inline const std::byte* read_varint(const std::byte* first, const std::byte* last, u128& value) noexcept {
+        const std::byte* p = first;
+        unsigned shift = 0;
+
+        // The first 9 bytes, 63 bits, fit in one u64.
+        u64 lo = 0;
+        for (; p != last && shift < 63; shift += 7) {
+            const u64 b = (u64)*p++;
+            lo |= (b & 0x7F) << shift;
+            if (b < 0x80) {
+                value = u128(lo, 0);
+                return p;
+            }
+        }
+
+        u128 r(lo, 0);
+        for (; p != last && shift < 126; shift += 7) {
+            const u64 b = (u64)*p++;
+            r |= u128(b & 0x7F) << shift;
+            if (b < 0x80) {
+                value = r;
+                return p;
+            }
+        }
+
+        // The 19th byte holds the top 2 bits and must be the last.
+        if (p != last && (u64)*p < 4) {
+            value = r | (u128((u64)*p) << 126);
+            return p + 1;
+        }
+        return nullptr;
+    }
+
+    // Writes n values as consecutive varints at p, which must have room for
+    // VARINT_MAX_BYTES · n bytes (or the sum of their varint_size), and returns
+    // the end of what was written.
+    inline std::byte* write_varints(std::byte* p, const u128* v, size_t n) noexcept {
+        for (size_t i = 0; i < n; i++)
+            p = write_varint(p, v[i]);
+        return p;
+    }
+
+    // Reads n consecutive varints from [first, last) into out and returns the end
+    // of them, or nullptr if the input is malformed or holds fewer than n.
+    inline const std::byte* read_varints(const std::byte* first, const std::byte* last, u128* out, size_t n) noexcept {
+        for (size_t i = 0; i < n && first; i++)
+            first = read_varint(first, last, out[i]);
+        return first;
+    }
+
+
+    // -----------------------------------------------------------------------------
+    // Modular arithmetic
+    // -----------------------------------------------------------------------------
+
+    // Returns the full 256 bit square of a. Three mul64 instead of mul128's four,
+    // since the two cross terms are equal.
+    inline U128_CONSTEXPR u256 sqr128(const u128& a) noexcept {
+        const u128 p00 = mul64(a.lo, a.lo);
+        const u128 p01 = mul64(a.lo, a.hi);
+        const u128 p11 = mul64(a.hi, a.hi);
+
+        // (p11 << 128) + (2·p01 << 64) + p00, with 2·p01 a 129 bit value
+        const u64 top = p01.hi >> 63;
+        const u128 twice = p01 << 1;
+        u256 r;
+        r.limb[0] = p00.lo;
+        unsigned char c = addcarry64(0, p00.hi, twice.lo, r.limb[1]);
+        c = addcarry64(c, p11.lo, twice.hi, r.limb[2]);
+        r.limb[3] = p11.hi + top + c;                // cannot overflow
+        return r;
+    }
+
+    // u256 / u128 → u256 quotient and u128 remainder, for m != 0: the basic_uint
+    // divmod of x by m zero extended, which takes its one limb path for m < 2⁶⁴.
+    inline U128_CONSTEXPR u256 divmod256(const u256& x, const u128& m, u128& rem) noexcept {
+        u256 r;
+        const u256 q = divmod(x, u256(m), r);
+        rem = r.lo();
+        return q;
+    }
+
+    // Returns x mod m for a 256 bit x and m != 0.
+    inline U128_CONSTEXPR u128 mod256(const u256& x, const u128& m) noexcept {
+        u128 rem;
+        divmod256(x, m, rem);
+        return rem;
+    }
+
+    // Montgomery arithmetic modulo an odd n, with R = 2¹²⁸.
+    //
+    // Values are held in Montgomery form, x·R mod n. In that form a modular
+    // multiply is one mul128 plus a reduction (REDC) that needs two more 128 bit
+    // multiplies and no division, so repeated multiplies by the same modulus,
+    // e.g. in pow(), are far cheaper than mulmod().
+    //
+    //      montgomery128 ctx(n);
+    //      u128 x = ctx.to_mont(a), y = ctx.to_mont(b);
+    //      u128 ab = ctx.from_mont(ctx.mul(x, y));     // a·b mod n
+    //
+    // Construction does one 256 / 128 reduction to find R² mod n.
+    struct montgomery128 {
+        u128 n;         // the modulus, odd
+        u128 ninv;      // -n⁻¹ mod 2¹²⁸
+        u128 r1;        // R mod n, i.e. 1 in Montgomery form
+        u128 r2;        // R² mod n, used by to_mont()
+
+        explicit U128_CONSTEXPR montgomery128(const u128& modulus) noexcept
+            : n(modulus), ninv(), r1(), r2() {
+            assert((modulus.lo & 1) == 1);
+
+            // Newton's iteration for the inverse mod 2¹²⁸: x·n ≡ 1 mod 2ᵏ implies
+            // x(2 - n·x)·n ≡ 1 mod 2²ᵏ. 3n ^ 2 is correct to 5 bits to start with,
+            // so five iterations reach 160 bits.
+            u128 x = (n * 3) ^ u128(2);
+            for (int i = 0; i < 5; i++)
+                x *= u128(2) - n * x;
+            ninv = -x;
+
+            r1 = (-n) % n;                          // 2¹²⁸ - n ≡ 2¹²⁸ mod n
+            r2 = mod256(u256(ZERO, r1), n);          // r1 · 2¹²⁸ mod n
+        }
+
+        // Montgomery reduction: returns t · R⁻¹ mod n, for t < n·R.
+        U128_CONSTEXPR u128 reduce(const u256& t) const noexcept {
+            // m = t · (-n⁻¹) mod R makes t + m·n divisible by R.
+            return reduce(t, mul128(t.lo() * ninv, n));
+        }
+
+        // The rest of the reduction, given mn = m·n for m = t.lo() · ninv, for
+        // callers with a multiply of their own (see wide_adx in u128_dispatch.h).
+        U128_CONSTEXPR u128 reduce(const u256& t, const u256& mn) const noexcept {
+            // The low halves sum to exactly 0 or R, so only their carry matters.
+            // The full sum is below 2·n·R, so the result is below 2n and needs at
+            // most one subtraction; a carry out of 128 bits means it is ≥ R > n.
+            const u128 s = t.hi() + mn.hi();
+            const u128 r = s + (u64)(t.lo() != ZERO);
+            const bool carry = s < t.hi() || r < s;
+            return (carry || r >= n) ? r - n : r;
+        }
+
+        // x → x·R mod n. x may be any value; it need not be reduced.
+        U128_CONSTEXPR u128 to_mont(const u128& x) const noexcept {
+            return reduce(mul128(x < n ? x : x % n, r2));
+        }
+        // x·R mod n → x
+        U128_CONSTEXPR u128 from_mont(const u128& x) const noexcept {
+            return reduce(u256(x));
+        }
+        // Product of two values in Montgomery form.
+        U128_CONSTEXPR u128 mul(const u128& a, const u128& b) const noexcept {
+            return reduce(mul128(a, b));
+        }
+        // Square of a value in Montgomery form.
+        U128_CONSTEXPR u128 sqr(const u128& a) const noexcept {
+            return reduce(sqr128(a));
+        }
+        // Sum and difference of two values in Montgomery form (or any two values < n).
+        U128_CONSTEXPR u128 add(const u128& a, const u128& b) const noexcept {
+            const u128 s = a + b;
+            return (s < a || s >= n) ? s - n : s;
+        }
+        U128_CONSTEXPR u128 sub(const u128& a, const u128& b) const noexcept {
+            return a < b ? a - b + n : a - b;
+        }
+        // base^e for base in Montgomery form; the result is in Montgomery form.
+        U128_CONSTEXPR u128 pow(const u128& base, const u128& e) const noexcept {
+            u128 result = r1;
+            for (int i = bit_width(e) - 1; i >= 0; i--) {
+                result = sqr(result);
+                if (((e >> (unsigned)i).lo & 1) != 0)
+                    result = mul(result, base);
+            }
+            return result;
+        }
+    };
+
+    // Returns a · b mod m, for m != 0.
+    // A single product is reduced directly; for many products by the same odd
+    // modulus, use montgomery128.
+    inline U128_CONSTEXPR u128 mulmod(const u128& a, const u128& b, const u128& m) noexcept {
+        return mod256(mul128(a, b), m);
+    }
+
+    // Returns a^e mod m, for m != 0. Uses Montgomery multiplication for odd m.
+    inline U128_CONSTEXPR u128 powmod(const u128& a, const u128& e, const u128& m) noexcept {
+        if (m == ONE)
+            return ZERO;
+        if ((m.lo & 1) != 0) {
+            const montgomery128 ctx(m);
+            return ctx.from_mont(ctx.pow(ctx.to_mont(a), e));
+        }
+        u128 result = ONE;
+        const u128 base = a % m;
+        for (int i = bit_width(e) - 1; i >= 0; i--) {
+            result = mulmod(result, result, m);
+            if (((e >> (unsigned)i).lo & 1) != 0)
+                result = mulmod(result, base, m);
+        }
+        return result;
+    }
+
+
+    // -----------------------------------------------------------------------------
+    // Division by an invariant divisor
+    // -----------------------------------------------------------------------------
+
+    // Division by a 64 bit divisor d that has been normalized (top bit set), using
+    // its precomputed reciprocal v = ⌊(2¹²⁸ - 1) / d⌋ - 2⁶⁴ (Möller & Granlund,
+    // "Improved division by invariant integers", algorithm 4). Divides hi:lo by d,
+    // stores the remainder in rem and returns the quotient. Requires hi < d.
+    // One mul64 and a few adds instead of a hardware divide.
+    inline U128_CONSTEXPR u64 div128by64_preinv(u64 hi, u64 lo, u64 d, u64 v, u64& rem) noexcept {
+        u128 q = mul64(v, hi) + u128(lo, hi + 1);
+        u64 r = lo - q.hi * d;
+        if (r > q.lo) {                 // unpredictable, but cheap: compiles to cmov
+            q.hi--;
+            r += d;
+        }
+        if (r >= d) {                   // rare
+            q.hi++;
+            r -= d;
+        }
+        rem = r;
+        return q.hi;
+    }
+
+    // u128_divider: divides by a fixed divisor d without a hardware divide.
+    //
+    // The constructor does the one division needed to find a reciprocal of d;
+    // afterwards divide() and mod() use only multiplies, adds and shifts.
+    //
+    //      const u128_divider shards(num_shards);
+    //      u128 shard = id % shards;                   // or shards.mod(id)
+    //
+    // - d < 2⁶⁴: two Möller-Granlund 2-by-1 steps (two mul64) on the normalized d
+    // - d ≥ 2⁶⁴: Granlund-Montgomery round-up multiply, q = (t + (n - t) / 2) >> (l - 1)
+    //   with t = mulhi(m, n) and l = ⌈log2 d⌉, which handles every d with a 128 bit m
+    //
+    // Usable in constant expressions wherever U128_CONSTEXPR is constexpr.
+    struct u128_divider {
+        u128 d;         // the divisor
+        u128 magic;     // m for d ≥ 2⁶⁴; for d < 2⁶⁴ the reciprocal of d << shift, in magic.lo
+        int shift;      // l - 1 for d ≥ 2⁶⁴; the normalization shift for d < 2⁶⁴
+
+        explicit U128_CONSTEXPR u128_divider(const u128& divisor) noexcept
+            : d(divisor), magic(), shift(0) {
+            assert(divisor != ZERO);
+            if (d.hi == 0) {
+                shift = countl_zero64(d.lo);
+                const u64 dn = d.lo << shift;
+                u64 unused = 0;
+                magic = u128(div128by64(~dn, UINT64_MAX, dn, unused));
+            }
+            else {
+                // m = ⌊2¹²⁸ (2ˡ - d) / d⌋ + 1, which fits in 128 bits since 2ˡ - d < d.
+                const int l = bit_width(d - ONE);                  // 65 ≤ l ≤ 128
+                const u128 twol_minus_d = (l == 128) ? -d : (ONE << (unsigned)l) - d;
+                u128 unused;
+                magic = divmod256(u256(ZERO, twol_minus_d), d, unused).lo() + ONE;
+                shift = l - 1;
+            }
+        }
+        explicit U128_CONSTEXPR u128_divider(u64 divisor) noexcept
+            : u128_divider(u128(divisor)) {}
+
+        // n / d, storing n % d in rem
+        U128_CONSTEXPR u128 divmod(const u128& n, u128& rem) const noexcept {
+            if (d.hi == 0) {
+                // Normalize the numerator with the divisor: n << shift = n2:n1:n0,
+                // with n2 < 2^shift ≤ dn, so both 2-by-1 steps meet hi < d.
+                const unsigned s = (unsigned)shift;
+                const u64 dn = d.lo << s;
+                const u64 n2 = s ? n.hi >> (64 - s) : 0;
+                const u128 n10 = n << s;
+                u64 r = 0;
+                const u64 q1 = div128by64_preinv(n2, n10.hi, dn, magic.lo, r);
+                const u64 q0 = div128by64_preinv(r, n10.lo, dn, magic.lo, r);
+                rem = u128(r >> s);
+                return { q0, q1 };
+            }
+            const u128 t = mulhi(magic, n);
+            const u128 q = (t + ((n - t) >> 1)) >> (unsigned)shift;
+            rem = n - q * d;
+            return q;
+        }
+        U128_CONSTEXPR u128 divide(const u128& n) const noexcept {
+            u128 rem;
+            return divmod(n, rem);
+        }
+        U128_CONSTEXPR u128 mod(const u128& n) const noexcept {
+            u128 rem;
+            divmod(n, rem);
+            return rem;
+        }
+
+        friend U128_CONSTEXPR u128 operator/(const u128& n, const u128_divider& div) noexcept {
+            return div.divide(n);
+        }
+        friend U128_CONSTEXPR u128 operator%(const u128& n, const u128_divider& div) noexcept {
+            return div.mod(n);
+        }
+        friend U128_CONSTEXPR u128& operator/=(u128& n, const u128_divider& div) noexcept {
+            return n = div.divide(n);
+        }
+        friend U128_CONSTEXPR u128& operator%=(u128& n, const u128_divider& div) noexcept {
+            return n = div.mod(n);
+        }
+    };
+
+
+    // -----------------------------------------------------------------------------
+    // Integer functions
+    // -----------------------------------------------------------------------------
+
+    // floor(log₂ x), or -1 for x == 0
+    inline U128_CONSTEXPR int ilog2(const u128& x) noexcept {
+        return bit_width(x) - 1;
+    }
+
+    // 10⁰ … 10³⁸, every power of ten below 2¹²⁸
+    struct pow10_table {
+        u128 v[39];
+        constexpr pow10_table() : v() {
+            v[0] = ONE;
+            for (int i = 1; i < 39; i++)
+                v[i] = (v[i - 1] << 3) + (v[i - 1] << 1);
+        }
+    };
+    static constexpr pow10_table POW10{};
+
+    // floor(log₁₀ x), or -1 for x == 0. ilog10(x) + 1 is the number of decimal
+    // digits of x > 0, to size a to_chars buffer exactly.
+    //
+    // bit_width(x) · 1233 / 4096 is log₁₀ of 2^bit_width(x) (1233 / 4096 is
+    // just below log₁₀ 2, close enough for 128 bits), which is the answer or
+    // one more; a single table compare tells which.
+    inline U128_CONSTEXPR int ilog10(const u128& x) noexcept {
+        const int t = (bit_width(x) * 1233) >> 12;
+        return t - (x < POW10.v[t]);
+    }
+
+    // base to the power e (mod 2¹²⁸), by squaring and multiplying: at most 2 ·
+    // bit_width(e) multiplies. See checked_mul to detect overflow.
+    inline U128_CONSTEXPR u128 ipow(u128 base, unsigned e) noexcept {
+        u128 result = ONE;
+        while (e) {
+            if (e & 1)
+                result *= base;
+            base *= base;
+            e >>= 1;
+        }
+        return result;
+    }
+
+    // floor(√x). Always fits in 64 bits.
+    //
+    // The double square root is within a few thousand of the answer (53 of its
+    // up to 64 bits are right); one Newton step r + (x - r²) / 2r, with r²
+    // exact from mul64, leaves it within one, and the last compares fix that.
+    inline u64 isqrt(const u128& x) noexcept {
+        const double d = std::sqrt(to_double(x));
+        u64 r = d >= 0x1p64 ? UINT64_MAX : static_cast<u64>(d);
+        if (x.hi != 0) {
+            // r ≥ 2³², and |x - r²| / r < r, so both divisions fit in 64 bits.
+            const u128 sq = mul64(r, r);
+            u64 rem;
+            if (sq > x) {
+                const u128 e = sq - x;
+                r -= div128by64(e.hi, e.lo, r, rem) >> 1;
+            }
+            else {
+                const u128 e = x - sq;
+                const u64 step = div128by64(e.hi, e.lo, r, rem) >> 1;
+                r = r + step < r ? UINT64_MAX : r + step;
+            }
+        }
+        while (mul64(r, r) > x)
+            r--;
+        while (r != UINT64_MAX && mul64(r + 1, r + 1) <= x)
+            r++;
+        return r;
+    }
+
+    // Greatest common divisor, with gcd(0, b) = b. Binary (Stein's) algorithm:
+    // strip common factors of 2 with countr_zero, then subtract the smaller
+    // odd value from the larger, which needs no division. Drops to u64 as
+    // soon as both values fit.
+    inline U128_CONSTEXPR u128 gcd(u128 a, u128 b) noexcept {
+        if (a == ZERO)
+            return b;
+        if (b == ZERO)
+            return a;
+        const int k = countr_zero(a | b);
+        a >>= countr_zero(a);
+        while ((a.hi | b.hi) != 0) {
+            b >>= countr_zero(b);
+            if (a > b) {
+                const u128 t = a;
+                a = b;
+                b = t;
+            }
+            b -= a;
+            if (b == ZERO)
+                return a << k;
+        }
+        u64 x = a.lo, y = b.lo;
+        while (y != 0) {
+            y >>= countr_zero64(y);
+            if (x > y) {
+                const u64 t = x;
+                x = y;
+                y = t;
+            }
+            y -= x;
+        }
+        return u128(x) << k;
+    }
+
+    // Least common multiple (mod 2¹²⁸), 0 if either is 0.
+    inline U128_CONSTEXPR u128 lcm(const u128& a, const u128& b) noexcept {
+        if (a == ZERO || b == ZERO)
+            return ZERO;
+        return a / gcd(a, b) * b;
+    }
+
+
+    // -----------------------------------------------------------------------------
+    // Hashing
+    // -----------------------------------------------------------------------------
+
+    // Odd 64 bit constants with well spread bits, as in wyhash.
+    constexpr u64 HASH_K0 = 0xa0761d6478bd642fULL;
+    constexpr u64 HASH_K1 = 0xe7037ed1a0b428dbULL;
+
+    // Multiplies a by b and folds the 128 bit product to 64 bits (the "mum"
+    // step of wyhash). Every input bit can reach every bit of the product, and
+    // the fold mixes the well mixed middle bits into both halves.
+    inline U128_CONSTEXPR u64 hash_mum(u64 a, u64 b) noexcept {
+        const u128 p = mul64(a, b);
+        return p.lo ^ p.hi;
+    }
+
+    // The per seed part of hash128, for callers hashing many keys with one seed.
+    inline U128_CONSTEXPR u64 hash_mix_seed(u64 seed) noexcept {
+        return seed ^ hash_mum(seed ^ HASH_K0, HASH_K1);
+    }
+
+    // hash128 with a seed already passed through hash_mix_seed.
+    inline U128_CONSTEXPR u64 hash128_mixed(const u128& v, u64 mixed_seed) noexcept {
+        const u64 a = v.lo ^ HASH_K1;
+        const u64 b = v.hi ^ mixed_seed;
+        const u128 p = mul64(a, b);
+        return hash_mum(a ^ p.lo ^ HASH_K0 ^ 16, b ^ p.hi ^ HASH_K1);
+    }
+
+    // Hashes v in two multiplications, as wyhash does a 16 byte input: one
+    // mul64 of the keyed halves, then a mum of its two words. Two differences
+    // from wyhash itself, so the values are not wyhash's: the halves are taken
+    // as they are rather than reassembled from 32 bit reads, and the first
+    // product is xored with its inputs (wyhash's WYHASH_CONDOM=2 mode). Without
+    // that, a or b zero makes the product zero, and every v.lo == HASH_K1 would
+    // hash alike.
+    //
+    // Unlike std::hash<uint64_t> (the identity in libstdc++ and libc++),
+    // neighbouring values land far apart, so sequential keys spread evenly
+    // over the buckets of an open addressing table. Not meant to resist
+    // deliberate collisions: for keys an adversary chooses, use a secret
+    // random seed at the least.
+    inline U128_CONSTEXPR u64 hash128(const u128& v, u64 seed = 0) noexcept {
+        return hash128_mixed(v, hash_mix_seed(seed));
+    }
+
+    // Hash function object with a run time seed, e.g. chosen at random per
+    // table so that iteration orders and collisions differ between runs.
+    struct seeded_hash {
+        u64 seed = 0;
+
+        U128_CONSTEXPR size_t operator()(const u128& v) const noexcept {
+            return static_cast<size_t>(hash128(v, seed));
+        }
+    };
+
+
+    // -----------------------------------------------------------------------------
+    // Random numbers
+    // -----------------------------------------------------------------------------
+
+    // Maps x to [0, n) as floor(x · n / 2¹²⁸), the upper half of the 256 bit
+    // product: a multiply instead of x % n. For uniformly random x this is as
+    // (nearly) uniform as x % n; for exact uniformity use uniform_below.
+    inline U128_CONSTEXPR u128 reduce(const u128& x, const u128& n) noexcept {
+        return mulhi(x, n);
+    }
+
+    // 128 random bits from rng. rng is either a uniform random bit generator
+    // producing full 64 bit values (std::mt19937_64, pcg64_dxsm), called twice,
+    // or one whose operator() returns a u128.
+    template<typename Rng>
+    inline u128 random_u128(Rng& rng) {
+        if constexpr (std::is_same<decltype(rng()), u128>::value) {
+            return rng();
+        }
+        else {
+            static_assert(Rng::min() == 0 && Rng::max() == UINT64_MAX,
+                "random_u128 needs a generator of full 64 bit values");
+            const u64 lo = rng();
+            return u128(lo, rng());
+        }
+    }
+
+    // Returns a uniformly distributed value in [0, n), for n != 0.
+    //
+    // Lemire's nearly divisionless method: reduce a random x to x·n / 2¹²⁸, but
+    // reject x if the low half of x·n falls in the 2¹²⁸ mod n values that would
+    // make some results more likely. That test needs the one division,
+    // 2¹²⁸ mod n, only when the low half is below n, which for random x is
+    // rare unless n is close to 2¹²⁸.
+    template<typename Rng>
+    inline u128 uniform_below(Rng& rng, const u128& n) {
+        assert(n != ZERO);
+        u256 m = mul128(random_u128(rng), n);
+        if (m.lo() < n) {
+            const u128 threshold = (ZERO - n) % n;     // 2¹²⁸ mod n
+            while (m.lo() < threshold)
+                m = mul128(random_u128(rng), n);
+        }
+        return m.hi();
+    }
+
+    // PCG64 DXSM (O'Neill's PCG with a 128 bit LCG state and the "double
+    // xorshift multiply" output, as used by NumPy): 64 bits per call, period
+    // 2¹²⁸, and one generator per stream, for 2¹²⁷ streams.
+    //
+    // The LCG step uses a 64 bit multiplier, so it is one mul64 plus one
+    // 64 bit multiply rather than a full 128 × 128 product. Satisfies
+    // UniformRandomBitGenerator, so works with <random> distributions.
+    struct pcg64_dxsm {
+        using result_type = u64;
+        static constexpr u64 MULTIPLIER = 0xda942042e4dd58b5ULL;
+
+        u128 state;
+        u128 inc;   // odd, selects the stream
+
+        U128_CONSTEXPR pcg64_dxsm() noexcept : pcg64_dxsm(u128(0x853c49e6748fea9bULL), u128(0xda3e39cb94b95bdbULL)) {}
+
+        // Seeds as PCG's srandom does: the same seed on different streams gives
+        // unrelated sequences.
+        U128_CONSTEXPR explicit pcg64_dxsm(const u128& seed, const u128& stream = u128(0xda3e39cb94b95bdbULL)) noexcept
+            : state(), inc((stream << 1) | ONE) {
+            step();
+            state += seed;
+            step();
+        }
+
+        static constexpr u64 min() noexcept { return 0; }
+        static constexpr u64 max() noexcept { return UINT64_MAX; }
+
+        // state · MULTIPLIER + inc (mod 2¹²⁸)
+        U128_CONSTEXPR void step() noexcept {
+            u128 p = mul64(state.lo, MULTIPLIER);
+            p.hi += state.hi * MULTIPLIER;
+            state = p + inc;
+        }
+
+        // The output is computed from the state before the step, so it does
+        // not wait on the step's multiply.
+        U128_CONSTEXPR u64 operator()() noexcept {
+            u64 hi = state.hi;
+            const u64 lo = state.lo | 1;
+            step();
+            hi ^= hi >> 32;
+            hi *= MULTIPLIER;
+            hi ^= hi >> 48;
+            return hi * lo;
+        }
+
+        // Skips ahead by delta outputs in O(log delta) steps (Brown's algorithm,
+        // composing the LCG with itself by repeated squaring), e.g. to give each
+        // thread of a simulation its own disjoint block of one sequence.
+        U128_CONSTEXPR void discard(u128 delta) noexcept {
+            u128 mult(MULTIPLIER), add = inc;
+            u128 acc_mult = ONE, acc_add = ZERO;
+            while (delta != ZERO) {
+                if (delta.lo & 1) {
+                    acc_mult *= mult;
+                    acc_add = acc_add * mult + add;
+                }
+                add = (mult + ONE) * add;
+                mult *= mult;
+                delta >>= 1;
+            }
+            state = acc_mult * state + acc_add;
+        }
+
+        friend constexpr bool operator==(const pcg64_dxsm& a, const pcg64_dxsm& b) noexcept {
+            return a.state == b.state && a.inc == b.inc;
+        }
+        friend constexpr bool operator!=(const pcg64_dxsm& a, const pcg64_dxsm& b) noexcept {
+            return !(a == b);
+        }
+    };
+
+
+#if EnablePortableMultiplyVerification
+
+    // -----------------------------------------------------------------------------
+    // Compare our portable multiplication result to the compiler intrinsic version.
+    // -----------------------------------------------------------------------------
+    //
+    // Returns true if both 128-bit results match; otherwise prints diagnostics.
+    //
+    // _umul128(a,b,&hi) is a MSVC intrinsic that computes the full 128-bit
+    // unsigned product of a and b. It stores the upper 64 bits into *hi and
+    // returns the lower 64 bits. Other compilers use unsigned __int128, where
+    // they have it, and mul64 otherwise (which is then the portable code too).
+    //
+    // The test confirms that our portable version produces *identical* lo and hi
+    // values for a large set of random and edge-case inputs.
+    //
+    bool test_product(u64 a, u64 b, bool mute = false) {
+        // Compute product using our portable implementation
+        u128 prod = mul64_portable(a, b);
+
+        // Compute reference product using hardware intrinsic
+#if defined(_MSC_VER)
+        u64 hi;                      // must be declared *before* calling
+        u64 lo = _umul128(a, b, &hi); // returns low 64 bits, sets high 64 bits
+#elif defined(__SIZEOF_INT128__)
+        const unsigned __int128 p = (unsigned __int128)a * b;
+        const u64 lo = (u64)p, hi = (u64)(p >> 64);
+#else
+        const u128 ref = mul64(a, b);
+        const u64 lo = ref.lo, hi = ref.hi;
+#endif
+
+        // Optionally print detailed comparison
+        if (!mute) {
+            std::cout << a << " * " << b << "\n";
+            std::cout << "prod = { " << prod.lo << ", " << prod.hi << " }\n";
+            std::cout << "ref  = { " << lo << ", " << hi << " }\n";
+            std::cout << (lo == prod.lo && hi == prod.hi ?
+                "*** SUCCESS ***\n\n" :
+                "*** FAIL ***\n\n");
+        }
+
+        // Return true if all 128 bits match exactly
+        return (lo == prod.lo && hi == prod.hi);
+    }
+
+    // -----------------------------------------------------------------------------
+    // Bulk test driver — runs thousands of random and deterministic test cases
+    // to ensure our 64×64→128 multiply matches the hardware intrinsic exactly.
+    // -----------------------------------------------------------------------------
+    bool test_product() {
+        int failures = 0;
+
+        // Use std::random_device to generate non-deterministic 64-bit inputs
+        std::random_device rd;
+        for (int i = 0; i < 10000; i++) {
+            // Combine two 32-bit random values to form a full 64-bit number
+            u64 a = rd() | (static_cast<u64>(rd()) << 32);
+            u64 b = rd() | (static_cast<u64>(rd()) << 32);
+
+            // Accumulate any mismatches
+            failures += (test_product(a, b, true) ? 0 : 1);
+        }
+
+        // -------------------------------------------------------------------------
+        // Deterministic corner cases to check boundaries and carries:
+        // -------------------------------------------------------------------------
+        failures += (test_product(0, 0) ? 0 : 1);                       // zero × zero
+        failures += (test_product(1, 1) ? 0 : 1);                       // small × small
+        failures += (test_product(1, UINT64_MAX) ? 0 : 1);              // 1 × max
+        failures += (test_product(UINT64_MAX, 1) ? 0 : 1);              // max × 1
+        failures += (test_product(UINT64_MAX, UINT64_MAX) ? 0 : 1);     // max × max (full carry propagation)
+        failures += (test_product(0x100000001ULL, 0x100000001ULL) ? 0 : 1); // cross-boundary pattern (2^32+1)^2
+        failures += (test_product(0xFFFFFFFFFFFFFFFEULL, 0xFFFFFFFFFFFFFFFDULL) ? 0 : 1);
+        failures += (test_product(0xFFFFFFFFFFFFFFFDULL, 0xFFFFFFFFFFFFFFFEULL) ? 0 : 1);
+
+        // Print final test summary
+        std::cout << "N Failures = " << failures << "\n";
+
+        // Return true if any failures occurred (for test frameworks)
+        return (failures > 0);
+    }
+#endif
+
+
+#if U128_SELF_TEST
+
+    // -----------------------------------------------------------------------------
+    // Self tests
+    // -----------------------------------------------------------------------------
+    //
+    // Randomized checks of the algorithms that are easy to get subtly wrong. Each
+    // compares against an identity or the slow reference arithmetic below, never
+    // a compiler's 128 bit type, so that they run with every compiler. Each prints
+    // the checks that fail and returns how many did, and takes the seed of its
+    // inputs so that a failure can be reproduced. self_test() runs them all;
+    // the companion headers have their own, such as test_batch_kernels().
+
+    // Prints a failed check and returns 1, to be added up.
+    inline int self_test_fail(const char* what, const std::string& a, const std::string& b = std::string()) {
+        std::cout << "self test failed: " << what << " " << a << " " << b << "\n";
+        return 1;
+    }
+
+    // Random values weighted towards the ones that exercise carries, borrows and
+    // normalization: 0, 1, all ones, single bits and runs of ones.
+    inline u64 self_test_u64(std::mt19937_64& rng) {
+        const u64 r = rng();
+        switch (rng() % 8) {
+        case 0: return 0;
+        case 1: return 1 + (r & 3);
+        case 2: return UINT64_MAX - (r & 3);
+        case 3: return 1ULL << (r & 63);
+        case 4: return UINT64_MAX << (r & 63);
+        case 5: return UINT64_MAX >> (r & 63);
+        default: return r;
+        }
+    }
+
+    // The same for u128, a quarter of them shifted down to any width.
+    inline u128 self_test_u128(std::mt19937_64& rng) {
+        const u128 v(self_test_u64(rng), self_test_u64(rng));
+        return rng() % 4 == 0 ? v >> (unsigned)(rng() % 128) : v;
+    }
+
+    // Reference arithmetic: numbers of any width as 32 bit digits, least
+    // significant first, added and multiplied digit by digit with the built-in
+    // 64 bit operations alone. Slow, but independent of mul64, addcarry64 and
+    // everything built on them.
+    using self_test_number = std::vector<u64>;
+
+    inline self_test_number self_test_number_of(u64 v) {
+        return { v & 0xFFFFFFFFULL, v >> 32 };
+    }
+    inline self_test_number self_test_number_of(const u128& v) {
+        return { v.lo & 0xFFFFFFFFULL, v.lo >> 32, v.hi & 0xFFFFFFFFULL, v.hi >> 32 };
+    }
+    template<size_t L>
+    inline self_test_number self_test_number_of(const basic_uint<L>& v) {
+        self_test_number x;
+        for (u64 limb : v.limb) {
+            x.push_back(limb & 0xFFFFFFFFULL);
+            x.push_back(limb >> 32);
+        }
+        return x;
+    }
+
+    // Limb i (64 bits) of x, 0 past its end.
+    inline u64 self_test_limb(const self_test_number& x, size_t i) {
+        const u64 lo = 2 * i < x.size() ? x[2 * i] : 0;
+        const u64 hi = 2 * i + 1 < x.size() ? x[2 * i + 1] : 0;
+        return lo | (hi << 32);
+    }
+
+    inline self_test_number self_test_add(const self_test_number& a, const self_test_number& b) {
+        self_test_number s(std::max(a.size(), b.size()) + 1);
+        u64 carry = 0;
+        for (size_t i = 0; i < s.size(); i++) {
+            const u64 t = (i < a.size() ? a[i] : 0) + (i < b.size() ? b[i] : 0) + carry;
+            s[i] = t & 0xFFFFFFFFULL;
+            carry = t >> 32;
+        }
+        return s;
+    }
+
+    inline self_test_number self_test_mul(const self_test_number& a, const self_test_number& b) {
+        self_test_number p(a.size() + b.size());
+        for (size_t i = 0; i < a.size(); i++) {
+            u64 carry = 0;
+            for (size_t j = 0; j < b.size(); j++) {
+                const u64 t = a[i] * b[j] + p[i + j] + carry;   // < 2⁶⁴
+                p[i + j] = t & 0xFFFFFFFFULL;
+                carry = t >> 32;
+            }
+            p[i + b.size()] = carry;
+        }
+        return p;
+    }
+
+    // The 128 bit word i of x: x modulo 2¹²⁸ for i = 0.
+    inline u128 self_test_u128_of(const self_test_number& x, size_t i = 0) {
+        return u128(self_test_limb(x, 2 * i), self_test_limb(x, 2 * i + 1));
+    }
+
+    // -1, 0 or 1 as a < b, a == b or a > b.
+    inline int self_test_compare(const self_test_number& a, const self_test_number& b) {
+        for (size_t i = std::max(a.size(), b.size()); i-- > 0; ) {
+            const u64 x = i < a.size() ? a[i] : 0, y = i < b.size() ? b[i] : 0;
+            if (x != y)
+                return x < y ? -1 : 1;
+        }
+        return 0;
+    }
+
+    // True if q · b + r == a and r < b.
+    inline bool self_test_is_divmod(const self_test_number& a, const self_test_number& b,
+        const self_test_number& q, const self_test_number& r) {
+        return self_test_compare(self_test_add(self_test_mul(q, b), r), a) == 0 && self_test_compare(r, b) < 0;
+    }
+
+    // divmod by u128 and u64 divisors, the operators, u128_divider, divmod256,
+    // and div128by64 and its portable version, each checked against
+    // q · b + r = a with r < b.
+    inline int test_division(u64 seed = 1, int count = 100000) {
+        std::mt19937_64 rng(seed);
+        int failures = 0;
+        for (int i = 0; i < count; i++) {
+            const u128 a = self_test_u128(rng);
+            // first 2ᵏ - 1, 2ᵏ and 2ᵏ + 1 for every k, the edges of the divider's
+            // and divmod's paths
+            u128 b = i < 384 ? (ONE << (unsigned)(i / 3)) + u128((u64)(i % 3)) - ONE : self_test_u128(rng);
+            if (b == ZERO)
+                b = ONE;
+
+            u128 r;
+            const u128 q = divmod(a, b, r);
+            u128 q2 = a, r2 = a;
+            q2 /= b;
+            r2 %= b;
+            if (a / b != q || a % b != r || q2 != q || r2 != r)
+                failures += self_test_fail("operator/", a.to_string_hex(), b.to_string_hex());
+            // and exact multiples of b and their neighbours, which random
+            // numerators almost never are, also through a u128_divider and
+            // with divmod256 as the low half of a 256 bit numerator
+            const u128_divider div(b);
+            for (const u128& c : { a, q * b, q * b - ONE, q * b + b - ONE }) {
+                u128 cr;
+                const u128 cq = divmod(c, b, cr);
+                if (!self_test_is_divmod(self_test_number_of(c), self_test_number_of(b), self_test_number_of(cq), self_test_number_of(cr)))
+                    failures += self_test_fail("divmod", c.to_string_hex(), b.to_string_hex());
+                u128 dr;
+                u128 dq = c, dm = c;
+                dq /= div;
+                dm %= div;
+                if (div.divmod(c, dr) != cq || dr != cr || c / div != cq || c % div != cr || div.divide(c) != cq ||
+                    div.mod(c) != cr || dq != cq || dm != cr)
+                    failures += self_test_fail("u128_divider", c.to_string_hex(), b.to_string_hex());
+
+                const u256 x(c, a);
+                u128 xr;
+                const u256 xq = divmod256(x, b, xr);
+                if (!self_test_is_divmod(self_test_number_of(x), self_test_number_of(b), self_test_number_of(xq), self_test_number_of(xr)) ||
+                    mod256(x, b) != xr)
+                    failures += self_test_fail("divmod256", a.to_string_hex() + " " + c.to_string_hex(), b.to_string_hex());
+            }
+
+            const u64 d = b.lo ? b.lo : 1;
+            u64 r64 = 0;
+            const u128 q64 = divmod(a, d, r64);
+            if (!self_test_is_divmod(self_test_number_of(a), self_test_number_of(d), self_test_number_of(q64), self_test_number_of(r64)))
+                failures += self_test_fail("divmod u64", a.to_string_hex(), std::to_string(d));
+            if (a / d != q64 || a % d != u128(r64))
+                failures += self_test_fail("operator/ u64", a.to_string_hex(), std::to_string(d));
+            const u128_divider div64(d);
+            if (a / div64 != q64 || a % div64 != u128(r64))
+                failures += self_test_fail("u128_divider u64", a.to_string_hex(), std::to_string(d));
+            const u64 hi = a.hi % d;        // div128by64 requires hi < d
+            u64 rn = 0, rp = 0;
+            const u64 qn = div128by64(hi, a.lo, d, rn);
+            const u64 qp = div128by64_portable(hi, a.lo, d, rp);
+            if (qn != qp || rn != rp ||
+                !self_test_is_divmod(self_test_number_of(u128(a.lo, hi)), self_test_number_of(d), self_test_number_of(qn), self_test_number_of(rn)))
+                failures += self_test_fail("div128by64", u128(a.lo, hi).to_string_hex(), std::to_string(d));
+        }
+        return failures;
+    }
+
+    // Addition, subtraction and multiplication against the reference
+    // arithmetic, with the carries and borrows of add64, sub64, addcarry64 and
+    // subborrow64; (a - b) + b == a modulo 2¹²⁸.
+    inline int test_arithmetic(u64 seed = 1, int count = 100000) {
+        std::mt19937_64 rng(seed);
+        int failures = 0;
+        for (int i = 0; i < count; i++) {
+            const u128 a = self_test_u128(rng), b = self_test_u128(rng);
+            const u64 x = self_test_u64(rng), y = self_test_u64(rng);
+            const self_test_number na = self_test_number_of(a), nb = self_test_number_of(b);
+
+            u128 sum = a, diff = a;
+            sum += b;
+            diff -= b;
+            if (a + b != self_test_u128_of(self_test_add(na, nb)) || sum != a + b ||
+                a + x != self_test_u128_of(self_test_add(na, self_test_number_of(x))) || x + a != a + x)
+                failures += self_test_fail("operator+", a.to_string_hex(), b.to_string_hex());
+            if (self_test_u128_of(self_test_add(self_test_number_of(a - b), nb)) != a || diff != a - b ||
+                self_test_u128_of(self_test_add(self_test_number_of(a - x), self_test_number_of(x))) != a ||
+                self_test_u128_of(self_test_add(self_test_number_of(x - b), nb)) != u128(x))
+                failures += self_test_fail("operator-", a.to_string_hex(), b.to_string_hex());
+            if (-a + a != ZERO || -(-a) != a)
+                failures += self_test_fail("unary -", a.to_string_hex());
+
+            const u128 s = add64(x, y);
+            if (self_test_compare(self_test_number_of(s), self_test_add(self_test_number_of(x), self_test_number_of(y))) != 0)
+                failures += self_test_fail("add64", std::to_string(x), std::to_string(y));
+            // x - y + 2⁶⁴ · borrow
+            const u128 d = sub64(x, y);
+            const self_test_number borrowed = d.hi ? self_test_number_of(u128(x, 1)) : self_test_number_of(x);
+            if ((d.hi != 0 && d.hi != UINT64_MAX) ||
+                self_test_compare(self_test_add(self_test_number_of(d.lo), self_test_number_of(y)), borrowed) != 0)
+                failures += self_test_fail("sub64", std::to_string(x), std::to_string(y));
+
+            const self_test_number p = self_test_mul(na, nb);
+            const u256 wide = mul128(a, b);
+            if (self_test_compare(self_test_number_of(wide), p) != 0 || wide.lo() != self_test_u128_of(p) || wide.hi() != self_test_u128_of(p, 1))
+                failures += self_test_fail("mul128", a.to_string_hex(), b.to_string_hex());
+            if (a * b != self_test_u128_of(p) || a * x != self_test_u128_of(self_test_mul(na, self_test_number_of(x))) || x * a != a * x)
+                failures += self_test_fail("operator*", a.to_string_hex(), b.to_string_hex());
+            if (mulhi(a, b) != self_test_u128_of(p, 1))
+                failures += self_test_fail("mulhi", a.to_string_hex(), b.to_string_hex());
+            const self_test_number pxy = self_test_mul(self_test_number_of(x), self_test_number_of(y));
+            if (self_test_compare(self_test_number_of(mul64(x, y)), pxy) != 0 || self_test_compare(self_test_number_of(mul64_portable(x, y)), pxy) != 0)
+                failures += self_test_fail("mul64", std::to_string(x), std::to_string(y));
+            if (mulhi64(x, y) != self_test_limb(pxy, 1))
+                failures += self_test_fail("mulhi64", std::to_string(x), std::to_string(y));
+            for (unsigned char carry_in = 0; carry_in < 2; carry_in++) {
+                u64 out = 0, out_portable = 0;
+                const unsigned char carry = addcarry64(carry_in, x, y, out);
+                const unsigned char carry_portable = addcarry64_portable(carry_in, x, y, out_portable);
+                const self_test_number expect = self_test_add(self_test_add(self_test_number_of(x), self_test_number_of(y)), self_test_number_of(u64(carry_in)));
+                if (carry != carry_portable || out != out_portable || carry > 1 ||
+                    self_test_compare(self_test_number_of(u128(out, carry)), expect) != 0)
+                    failures += self_test_fail("addcarry64", std::to_string(x), std::to_string(y));
+                // x - y - borrow_in + 2⁶⁴ · borrow == x
+                const unsigned char borrow = subborrow64(carry_in, x, y, out);
+                const unsigned char borrow_portable = subborrow64_portable(carry_in, x, y, out_portable);
+                const self_test_number back = self_test_add(self_test_add(self_test_number_of(out), self_test_number_of(y)), self_test_number_of(u64(carry_in)));
+                if (borrow != borrow_portable || out != out_portable || borrow > 1 ||
+                    self_test_compare(back, self_test_number_of(u128(x, borrow))) != 0)
+                    failures += self_test_fail("subborrow64", std::to_string(x), std::to_string(y));
+            }
+
+            // u256 comparisons, on pairs that share the upper or the lower half
+            const u256 v(a, b);
+            const u256 w = rng() % 3 == 0 ? u256(self_test_u128(rng), b) : rng() % 2 ? u256(a, self_test_u128(rng)) : v;
+            const int order = self_test_compare(self_test_number_of(v), self_test_number_of(w));
+            if ((v < w) != (order < 0) || (v <= w) != (order <= 0) || (v > w) != (order > 0) ||
+                (v >= w) != (order >= 0) || (v == w) != (order == 0) || (v != w) != (order != 0))
+                failures += self_test_fail("u256 comparison", v.to_string_hex(), w.to_string_hex());
+        }
+        return failures;
+    }
+
+    // v in the given base, one divmod per digit.
+    inline std::string self_test_in_base(u128 v, int base) {
+        std::string s;
+        do {
+            u64 d = 0;
+            v = divmod(v, (u64)base, d);
+            s.insert(s.begin(), "0123456789abcdefghijklmnopqrstuvwxyz"[d]);
+        } while (v != ZERO);
+        return s;
+    }
+
+    // to_chars in every base, to_string and the hex formats against
+    // self_test_in_base, on random values and on the powers of ten and their
+    // neighbours, where the 19 digit chunks split; every output read back, and
+    // the limits of from_chars.
+    inline int test_text(u64 seed = 1, int count = 20000) {
+        std::mt19937_64 rng(seed);
+        std::vector<u128> values = { ZERO, MAX };
+        for (u128 p = ONE; p <= MAX / 10; p *= 10) {
+            values.push_back(p * 10 - ONE);
+            values.push_back(p * 10);
+            values.push_back(p * 10 + ONE);
+        }
+        for (int i = 0; i < count; i++)
+            values.push_back(self_test_u128(rng));
+
+        int failures = 0;
+        for (const u128& v : values) {
+            const std::string expect = self_test_in_base(v, 10);
+            char buf[39];
+            const std::to_chars_result w = to_chars(buf, buf + sizeof(buf), v);
+            if (w.ec != std::errc() || std::string(buf, w.ptr) != expect || v.to_string() != expect)
+                failures += self_test_fail("to_chars", v.to_string_hex(), expect);
+            // one character short, and exactly long enough
+            const std::to_chars_result short_w = to_chars(buf, buf + expect.size() - 1, v);
+            if (short_w.ec != std::errc::value_too_large || short_w.ptr != buf + expect.size() - 1 ||
+                to_chars(buf, buf + expect.size(), v).ptr != buf + expect.size())
+                failures += self_test_fail("to_chars buffer size", v.to_string_hex(), expect);
+            u64 low = 0, low_expect = 0;
+            if (divmod_pow10_19(v, low) != divmod(v, POW10_19, low_expect) || low != low_expect)
+                failures += self_test_fail("divmod_pow10_19", v.to_string_hex());
+
+            const int base = 2 + (int)(rng() % 35);
+            const std::string in_base = self_test_in_base(v, base);
+            char wide_buf[128];
+            const std::to_chars_result wb = to_chars(wide_buf, wide_buf + sizeof(wide_buf), v, base);
+            if (wb.ec != std::errc() || std::string(wide_buf, wb.ptr) != in_base ||
+                to_chars(wide_buf, wide_buf + in_base.size() - 1, v, base).ec != std::errc::value_too_large)
+                failures += self_test_fail("to_chars base", v.to_string_hex(), std::to_string(base));
+
+            const std::string hex = self_test_in_base(v, 16);
+            const std::string padded = std::string(32 - hex.size(), '0') + hex;
+            char hex_buf[32];
+            std::ostringstream os;
+            os.width(36);
+            os.fill('*');
+            os << v;
+            if (write_hex_32(hex_buf, v) != hex_buf + 32 || std::string(hex_buf, 32) != padded ||
+                v.to_string_hex() != "0x" + padded || os.str() != "**0x" + padded)
+                failures += self_test_fail("write_hex_32", v.to_string_hex(), padded);
+            const u256 with_hi(v, ~v);
+            if (with_hi.to_string_hex() != "0x" + (~v).to_string_hex().substr(2) + padded)
+                failures += self_test_fail("u256::to_string_hex", with_hi.to_string_hex());
+
+            std::string upper = in_base;
+            for (char& c : upper)
+                c = c >= 'a' ? (char)(c - 'a' + 'A') : c;
+            u128 back;
+            const std::from_chars_result r = from_chars(upper.data(), upper.data() + upper.size(), back, base);
+            if (r.ec != std::errc() || r.ptr != upper.data() + upper.size() || back != v)
+                failures += self_test_fail("from_chars", upper, std::to_string(base));
+            u128 back10, back16, back_hex;
+            if (!from_string(expect, back10) || back10 != v || !read_hex_32(hex_buf, back16) || back16 != v ||
+                !from_string(v.to_string_hex(), back_hex, 16) || back_hex != v)
+                failures += self_test_fail("from_string", expect);
+            // Digits, then a character just outside the digit ranges (in
+            // either base) and more digits: the parse stops at that character.
+            const char stop = "/:@G`g"[rng() % 6];
+            for (const int digits_base : { 10, 16 }) {
+                const std::string t = (digits_base == 10 ? expect : padded) + stop + "0123456789abcdef";
+                const std::from_chars_result tr = from_chars(t.data(), t.data() + t.size(), back, digits_base);
+                if (tr.ec != std::errc() || back != v || *tr.ptr != stop)
+                    failures += self_test_fail("from_chars stop", t, std::to_string(digits_base));
+            }
+            hex_buf[rng() % 32] = stop;
+            if (read_hex_32(hex_buf, back16) || from_string(expect + stop, back10))
+                failures += self_test_fail("parse accepted", std::string(hex_buf, 32), expect + stop);
+        }
+
+        // The value is left alone on failure.
+        struct limit { std::string s; int base; std::errc ec; size_t used; u128 value; };
+        const limit limits[] = {
+            { "340282366920938463463374607431768211455", 10, std::errc(), 39, MAX },
+            { "340282366920938463463374607431768211456", 10, std::errc::result_out_of_range, 39, ONE },
+            { "360000000000000000000000000000000000000", 10, std::errc::result_out_of_range, 39, ONE },
+            { "999999999999999999999999999999999999999", 10, std::errc::result_out_of_range, 39, ONE },
+            { "3402823669209384634633746074317682114550", 10, std::errc::result_out_of_range, 40, ONE },
+            { std::string(60, '0') + "1", 10, std::errc(), 61, ONE },
+            { "18446744073709551616x", 10, std::errc(), 20, u128(0, 1) },
+            { std::string(32, 'f'), 16, std::errc(), 32, MAX },
+            { "1" + std::string(32, '0'), 16, std::errc::result_out_of_range, 33, ONE },
+            { std::string(128, '1'), 2, std::errc(), 128, MAX },
+            { std::string(129, '1'), 2, std::errc::result_out_of_range, 129, ONE },
+            { "", 10, std::errc::invalid_argument, 0, ONE },
+            { "-1", 10, std::errc::invalid_argument, 0, ONE },
+            { "+1", 10, std::errc::invalid_argument, 0, ONE },
+            { "z", 35, std::errc::invalid_argument, 0, ONE },
+        };
+        for (const limit& l : limits) {
+            u128 v = ONE;
+            const std::from_chars_result r = from_chars(l.s.data(), l.s.data() + l.s.size(), v, l.base);
+            if (r.ec != l.ec || r.ptr != l.s.data() + l.used || v != l.value)
+                failures += self_test_fail("from_chars limit", l.s, std::to_string(l.base));
+        }
+        return failures;
+    }
+
+    // Bit i of x.
+    inline bool self_test_bit(const u128& x, int i) {
+        return ((i < 64 ? x.lo >> i : x.hi >> (i - 64)) & 1) != 0;
+    }
+
+    // The bit operations against loops over self_test_bit, and the intrinsic
+    // 64 bit primitives against their portable versions.
+    inline int test_bits(u64 seed = 1, int count = 20000) {
+        std::mt19937_64 rng(seed);
+        int failures = 0;
+        for (int i = 0; i < count; i++) {
+            const u128 x = self_test_u128(rng);
+            int leading = 0, trailing = 0, ones = 0, leading_ones = 0, trailing_ones = 0;
+            while (leading < 128 && !self_test_bit(x, 127 - leading))
+                leading++;
+            while (trailing < 128 && !self_test_bit(x, trailing))
+                trailing++;
+            while (leading_ones < 128 && self_test_bit(x, 127 - leading_ones))
+                leading_ones++;
+            while (trailing_ones < 128 && self_test_bit(x, trailing_ones))
+                trailing_ones++;
+            for (int k = 0; k < 128; k++)
+                ones += self_test_bit(x, k);
+            if (countl_zero(x) != leading || countr_zero(x) != trailing || countl_one(x) != leading_ones ||
+                countr_one(x) != trailing_ones || popcount(x) != ones || bit_width(x) != 128 - leading ||
+                has_single_bit(x) != (ones == 1))
+                failures += self_test_fail("bit counts", x.to_string_hex());
+
+            const u64 w = x.lo;
+            if (countl_zero64(w) != countl_zero64_portable(w) || countr_zero64(w) != countr_zero64_portable(w) ||
+                popcount64(w) != popcount64_portable(w) || countl_zero64(w) != countl_zero(u128(w)) - 64 ||
+                popcount64(w) != popcount(u128(w)))
+                failures += self_test_fail("64 bit counts", std::to_string(w));
+
+            // any rotation, including negative ones and whole turns
+            const int s = (int)(rng() % 521) - 260;
+            const u128 left = rotl(x, s), right = rotr(x, s);
+            const int r = ((s % 128) + 128) % 128;
+            bool ok = rotl(x, -s) == right;
+            for (int k = 0; k < 128; k++)
+                ok &= self_test_bit(left, (k + r) % 128) == self_test_bit(x, k) && self_test_bit(right, k) == self_test_bit(x, (k + r) % 128);
+            if (!ok)
+                failures += self_test_fail("rotl/rotr", x.to_string_hex(), std::to_string(s));
+        }
+        return failures;
+    }
+
+    // x shifted left by n (right for negative n) against self_test_bit, with the
+    // bits shifted past either end gone.
+    inline bool self_test_is_shift(const u128& y, const u128& x, int n) {
+        for (int k = 0; k < 128; k++) {
+            const int from = k - n;
+            if (self_test_bit(y, k) != (from >= 0 && from < 128 && self_test_bit(x, from)))
+                return false;
+        }
+        return true;
+    }
+
+    // Every shift count 0..255 on random values, which covers the word
+    // boundaries at 0, 63, 64 and 127 and the counts of 128 or more that shift
+    // everything out, plus shld128/shrd128 against the shifts of a 256 bit value.
+    inline int test_shifts(u64 seed = 1, int count = 200) {
+        std::mt19937_64 rng(seed);
+        int failures = 0;
+        for (int i = 0; i < count; i++) {
+            const u128 x = i == 0 ? MAX : self_test_u128(rng), y = self_test_u128(rng);
+            for (unsigned n = 0; n < 256; n++) {
+                u128 left = x, right = x;
+                left <<= n;
+                right >>= n;
+                if (!self_test_is_shift(x << n, x, (int)n) || !self_test_is_shift(x >> n, x, -(int)n) ||
+                    left != (x << n) || right != (x >> n))
+                    failures += self_test_fail("shift", x.to_string_hex(), std::to_string(n));
+
+                // hi:lo = x:y, so shld128 is bits 128..255 of (x:y) << n and shrd128 bits 0..127 of (x:y) >> n
+                const unsigned m = n & 127;
+                const u128 fl = shld128(x, y, n), fr = shrd128(x, y, n);
+                bool ok = true;
+                for (int k = 0; k < 128; k++) {
+                    const int from_left = k + 128 - (int)m, from_right = k + (int)m;
+                    ok &= self_test_bit(fl, k) == (from_left >= 128 ? self_test_bit(x, from_left - 128) : self_test_bit(y, from_left));
+                    ok &= self_test_bit(fr, k) == (from_right >= 128 ? self_test_bit(x, from_right - 128) : self_test_bit(y, from_right));
+                }
+                if (!ok)
+                    failures += self_test_fail("shld128/shrd128", x.to_string_hex() + " " + y.to_string_hex(), std::to_string(n));
+            }
+        }
+        return failures;
+    }
+
+    // (a + b) mod m for a, b < m.
+    inline u128 self_test_addmod(const u128& a, const u128& b, const u128& m) {
+        const u128 s = a + b;
+        return (s < a || s >= m) ? s - m : s;
+    }
+
+    // a · b mod m by double and add, one bit of a at a time, so it shares no
+    // code with mod256 or the Montgomery reduction.
+    inline u128 self_test_mulmod(const u128& a, const u128& b, const u128& m) {
+        const u128 bm = b % m;
+        u128 r = ZERO;
+        for (int k = 127; k >= 0; k--) {
+            r = self_test_addmod(r, r, m);
+            if (self_test_bit(a, k))
+                r = self_test_addmod(r, bm, m);
+        }
+        return r;
+    }
+
+    // sqr128, mod256, mulmod, montgomery128 and powmod against
+    // self_test_mulmod, for random moduli of every size, odd and even.
+    inline int test_montgomery(u64 seed = 1, int count = 2000) {
+        std::mt19937_64 rng(seed);
+        int failures = 0;
+        for (int i = 0; i < count; i++) {
+            u128 n = self_test_u128(rng);
+            if (n <= ONE)
+                n = u128(3);
+            const u128 odd = n | ONE;
+            const montgomery128 m(odd);
+            for (int j = 0; j < 8; j++) {
+                const u128 a = self_test_u128(rng), b = self_test_u128(rng);
+                if (sqr128(a) != mul128(a, a))
+                    failures += self_test_fail("sqr128", a.to_string_hex());
+
+                // hi·2¹²⁸ + lo ≡ hi·(2¹²⁸ mod n) + lo
+                const u128 r128 = (-n) % n;
+                if (mod256(u256(a, b), n) != self_test_addmod(self_test_mulmod(b, r128, n), a % n, n))
+                    failures += self_test_fail("mod256", a.to_string_hex() + " " + b.to_string_hex(), n.to_string());
+                if (mulmod(a, b, n) != self_test_mulmod(a, b, n))
+                    failures += self_test_fail("mulmod", a.to_string(), b.to_string());
+
+                const u128 x = m.to_mont(a), y = m.to_mont(b);
+                if (!(x < odd) || m.from_mont(x) != a % odd)
+                    failures += self_test_fail("to_mont", a.to_string(), odd.to_string());
+                if (m.from_mont(m.mul(x, y)) != self_test_mulmod(a, b, odd))
+                    failures += self_test_fail("montgomery128::mul", a.to_string(), b.to_string());
+                if (m.sqr(x) != m.mul(x, x))
+                    failures += self_test_fail("montgomery128::sqr", a.to_string(), odd.to_string());
+                const u128 as = a % odd, bs = b % odd;
+                if (m.add(as, bs) != self_test_addmod(as, bs, odd) ||
+                    self_test_addmod(m.sub(as, bs), bs, odd) != as)
+                    failures += self_test_fail("montgomery128::add/sub", a.to_string(), b.to_string());
+            }
+
+            // powmod against a square and multiply ladder, for the odd modulus and
+            // the possibly even n
+            const u128 a = self_test_u128(rng);
+            const u128 e = i < 4 ? u128((u64)i) : self_test_u128(rng);
+            for (const u128& mod : { odd, n }) {
+                u128 expect = ONE % mod;
+                for (int k = 127; k >= 0; k--) {
+                    expect = self_test_mulmod(expect, expect, mod);
+                    if (self_test_bit(e, k))
+                        expect = self_test_mulmod(expect, a, mod);
+                }
+                if (powmod(a, e, mod) != expect)
+                    failures += self_test_fail("powmod", a.to_string(), mod.to_string());
+            }
+        }
+        if (powmod(u128(5), u128(7), ONE) != ZERO)
+            failures += self_test_fail("powmod modulo 1", "5");
+
+        // Modulo 2¹²⁸ - 1, where R ≡ 1: 7 times its inverse makes the sum in
+        // REDC exactly 2¹²⁸, the one case in which adding the low half's carry
+        // overflows.
+        const montgomery128 max_m(MAX);
+        if (max_m.mul(u128(7), u128(0x9249249249249249ULL, 0x4924924924924924ULL)) != ONE)
+            failures += self_test_fail("montgomery128::reduce carry", MAX.to_string());
+        return failures;
+    }
+
+    // div_by<D> and mod_by<D> against divmod by D, for n and for the nearest
+    // multiples of D below n and their predecessors, where an inexact
+    // reciprocal would be off by one.
+    template<u64... D>
+    inline int test_div_by(const u128& n) {
+        int failures = 0;
+        auto check = [&](u64 d, const u128& q, u64 r, const u128& x) {
+            u64 expect = 0;
+            if (q != divmod(x, d, expect) || r != expect)
+                failures += self_test_fail("div_by", x.to_string(), std::to_string(d));
+        };
+        ((check(D, div_by<D>(n), mod_by<D>(n), n),
+          check(D, div_by<D>(n - n % D), mod_by<D>(n - n % D), n - n % D),
+          check(D, div_by<D>(n - n % D - ONE), mod_by<D>(n - n % D - ONE), n - n % D - ONE)), ...);
+        return failures;
+    }
+
+    // div_by and mod_by for divisors that take each of the three strategies of
+    // constant_divider, near their limits.
+    inline int test_constant_division(u64 seed = 1, int count = 20000) {
+        std::mt19937_64 rng(seed);
+        int failures = 0;
+        for (int i = 0; i < count; i++) {
+            const u128 n = i == 0 ? MAX : self_test_u128(rng);
+            failures += test_div_by<1, 2, 3, 5, 7, 10, 60, 641, 1000, 1000000000, 1000000007,
+                1000000000000000000ULL, 10000000000000000000ULL, 0x5555555555555555ULL,
+                (1ULL << 63) - 1, 1ULL << 63, (1ULL << 63) + 1, UINT64_MAX - 1, UINT64_MAX>(n);
+        }
+        return failures;
+    }
+
+    // True if the reference x does not fit in 128 bits.
+    inline bool self_test_above_128(const self_test_number& x) {
+        for (size_t i = 4; i < x.size(); i++)
+            if (x[i] != 0)
+                return true;
+        return false;
+    }
+
+    // The checked and saturating operations against the reference sum,
+    // difference and product. Half the pairs are scaled so that the exact
+    // product straddles 2¹²⁸, where overflow detection is decided.
+    inline int test_checked(u64 seed = 1, int count = 100000) {
+        std::mt19937_64 rng(seed);
+        int failures = 0;
+        for (int i = 0; i < count; i++) {
+            u128 a = self_test_u128(rng), b = self_test_u128(rng);
+            if (i % 2) {
+                const unsigned k = (unsigned)(rng() % 129);
+                a = k ? (a | u128(0, 1ULL << 63)) >> (k - 1) : ONE;
+                b = (b | u128(0, 1ULL << 63)) >> (128 - k + (unsigned)(rng() % 3));
+            }
+            const u64 b64 = b.lo;
+            const self_test_number na = self_test_number_of(a), nb = self_test_number_of(b);
+
+            const self_test_number sum = self_test_add(na, nb);
+            const checked_result add = checked_add(a, b);
+            if (add.value != a + b || add.overflow != self_test_above_128(sum) ||
+                saturating_add(a, b) != (add.overflow ? MAX : self_test_u128_of(sum)))
+                failures += self_test_fail("checked_add", a.to_string_hex(), b.to_string_hex());
+
+            const checked_result sub = checked_sub(a, b);
+            if (sub.value != a - b || sub.overflow != (self_test_compare(na, nb) < 0) ||
+                saturating_sub(a, b) != (sub.overflow ? ZERO : a - b))
+                failures += self_test_fail("checked_sub", a.to_string_hex(), b.to_string_hex());
+
+            const self_test_number product = self_test_mul(na, nb);
+            const checked_result mul = checked_mul(a, b);
+            if (mul.value != self_test_u128_of(product) || mul.overflow != self_test_above_128(product) ||
+                saturating_mul(a, b) != (mul.overflow ? MAX : mul.value))
+                failures += self_test_fail("checked_mul", a.to_string_hex(), b.to_string_hex());
+
+            const self_test_number product64 = self_test_mul(na, self_test_number_of(b64));
+            const checked_result mul64r = checked_mul(a, b64);
+            if (mul64r.value != self_test_u128_of(product64) || mul64r.overflow != self_test_above_128(product64) ||
+                saturating_mul(a, b64) != (mul64r.overflow ? MAX : mul64r.value))
+                failures += self_test_fail("checked_mul u64", a.to_string_hex(), std::to_string(b64));
+        }
+        return failures;
+    }
+
+    // mac64 and fma against the reference, and carry_save_accumulator against a
+    // reference running sum of mixed products, u64 and u128 terms, split over
+    // two merged accumulators. Every eighth run uses only the largest terms, so
+    // that the sum passes 2¹²⁸.
+    inline int test_accumulate(u64 seed = 1, int count = 2000) {
+        std::mt19937_64 rng(seed);
+        int failures = 0;
+        for (int i = 0; i < count; i++) {
+            const bool largest = i % 8 == 0;
+            carry_save_accumulator acc, other;
+            self_test_number sum;
+            for (int j = 0; j < 200; j++) {
+                const u64 a = largest ? UINT64_MAX : self_test_u64(rng), b = largest ? UINT64_MAX : self_test_u64(rng);
+                const u128 x = largest ? MAX : self_test_u128(rng);
+                carry_save_accumulator& into = j % 2 ? other : acc;
+                switch (rng() % 3) {
+                case 0: into.add(a, b); sum = self_test_add(sum, self_test_mul(self_test_number_of(a), self_test_number_of(b))); break;
+                case 1: into.add(a); sum = self_test_add(sum, self_test_number_of(a)); break;
+                default: into.add(x); sum = self_test_add(sum, self_test_number_of(x)); break;
+                }
+
+                // acc + a · b, whose bit 128 is the carry
+                u128 m = x;
+                const unsigned char carry = mac64(m, a, b);
+                const self_test_number mac = self_test_add(self_test_number_of(x), self_test_mul(self_test_number_of(a), self_test_number_of(b)));
+                if (m != self_test_u128_of(mac) || carry != self_test_limb(mac, 2))
+                    failures += self_test_fail("mac64", x.to_string_hex(), std::to_string(a) + " " + std::to_string(b));
+                const u128 c = self_test_u128(rng);
+                if (fma(x, a, c) != self_test_u128_of(self_test_add(self_test_mul(self_test_number_of(x), self_test_number_of(a)), self_test_number_of(c))))
+                    failures += self_test_fail("fma", x.to_string_hex(), std::to_string(a));
+            }
+            acc.merge(other);
+            if (self_test_compare(self_test_number_of(acc.total()), sum) != 0 || acc.value() != self_test_u128_of(sum))
+                failures += self_test_fail("carry_save_accumulator", self_test_u128_of(sum).to_string_hex());
+        }
+
+        // (2⁶⁴ - 1)² + 3 (2⁶⁴ - 1), where total() carries from the middle word
+        carry_save_accumulator acc;
+        acc.add(UINT64_MAX, UINT64_MAX);
+        for (int i = 0; i < 3; i++)
+            acc.add(UINT64_MAX);
+        if (acc.total() != u256(u128(UINT64_MAX - 1, 0), ONE) || acc.value() != u128(UINT64_MAX - 1, 0))
+            failures += self_test_fail("carry_save_accumulator middle carry", acc.value().to_string_hex());
+        return failures;
+    }
+
+    // True if the hashes of keys are distinct and their low 10 bits, the bucket
+    // in a 1024 bucket power of two table, fill every bucket to between half
+    // and one and a half times the average.
+    inline bool self_test_hashes_spread(const std::vector<u128>& keys, u64 seed) {
+        std::vector<u64> h(keys.size());
+        std::vector<size_t> buckets(1024);
+        for (size_t i = 0; i < keys.size(); i++) {
+            h[i] = hash128(keys[i], seed);
+            buckets[h[i] & 1023]++;
+        }
+        std::sort(h.begin(), h.end());
+        const size_t average = keys.size() / buckets.size();
+        return std::adjacent_find(h.begin(), h.end()) == h.end() &&
+            *std::min_element(buckets.begin(), buckets.end()) >= average / 2 &&
+            *std::max_element(buckets.begin(), buckets.end()) <= average + average / 2;
+    }
+
+    // hash128 against hash128_mixed and seeded_hash, and its quality: structured
+    // key sets (sequential lo or hi words, and lo == HASH_K1, which zeroes the
+    // first product) hash to distinct, evenly spread values, and flipping any
+    // one key bit flips close to half the hash bits on average.
+    inline int test_hash(u64 seed = 1) {
+        std::mt19937_64 rng(seed);
+        int failures = 0;
+        for (int i = 0; i < 1000; i++) {
+            const u128 v = self_test_u128(rng);
+            const u64 s = i % 2 ? self_test_u64(rng) : 0;
+            if (hash128(v, s) != hash128_mixed(v, hash_mix_seed(s)) || seeded_hash{ s }(v) != (size_t)hash128(v, s) ||
+                (s != 0 && hash128(v, s) == hash128(v)))
+                failures += self_test_fail("hash128", v.to_string_hex(), std::to_string(s));
+        }
+
+        const size_t n = 100000;
+        const u64 s = self_test_u64(rng);
+        std::vector<u128> k1(n), lo(n), hi(n);
+        for (size_t i = 0; i < n; i++) {
+            k1[i] = u128(HASH_K1, i);
+            lo[i] = u128(i, 0);
+            hi[i] = u128(0, i);
+        }
+        for (u64 key_seed : { (u64)0, s }) {
+            if (!self_test_hashes_spread(k1, key_seed))
+                failures += self_test_fail("hash128 spread, lo == HASH_K1", std::to_string(key_seed));
+            if (!self_test_hashes_spread(lo, key_seed) || !self_test_hashes_spread(hi, key_seed))
+                failures += self_test_fail("hash128 spread, sequential keys", std::to_string(key_seed));
+        }
+
+        u64 flipped = 0, trials = 0;
+        for (int i = 0; i < 200; i++) {
+            const u128 v = self_test_u128(rng);
+            const u64 h = hash128(v);
+            for (unsigned b = 0; b < 128; b++, trials++)
+                flipped += (u64)popcount64(h ^ hash128(v ^ (ONE << b)));
+        }
+        if (flipped < 30 * trials || flipped > 34 * trials)
+            failures += self_test_fail("hash128 avalanche", std::to_string((double)flipped / (double)trials));
+        return failures;
+    }
+
+    // A generator whose operator() returns a u128, for random_u128.
+    struct self_test_u128_rng {
+        std::mt19937_64& rng;
+        u128 operator()() { return self_test_u128(rng); }
+    };
+
+    // reduce against the reference product, uniform_below's range and balance,
+    // random_u128 for both kinds of generator, and pcg64_dxsm's step and output
+    // against their definitions and discard against stepping: n single steps
+    // for every n up to 300, discard(a) then discard(b) as discard(a + b), and
+    // discard(2¹²⁸ - 1) then one step as a whole period.
+    inline int test_random(u64 seed = 1) {
+        std::mt19937_64 rng(seed);
+        int failures = 0;
+        for (int i = 0; i < 20000; i++) {
+            const u128 x = self_test_u128(rng), n = i < 4 ? u128(0, 1ULL << 63) + u128((u64)i) - ONE : self_test_u128(rng);
+            if (reduce(x, n) != self_test_u128_of(self_test_mul(self_test_number_of(x), self_test_number_of(n)), 1))
+                failures += self_test_fail("reduce", x.to_string_hex(), n.to_string_hex());
+            if (n != ZERO && !(uniform_below(rng, n) < n))
+                failures += self_test_fail("uniform_below", n.to_string_hex());
+        }
+        if (uniform_below(rng, ONE) != ZERO)
+            failures += self_test_fail("uniform_below", "1");
+
+        // a coarse check that no value is badly over or under represented
+        size_t count[3] = {};
+        for (int i = 0; i < 30000; i++)
+            count[uniform_below(rng, u128(3)).lo]++;
+        for (size_t c : count)
+            if (c < 9000 || c > 11000)
+                failures += self_test_fail("uniform_below balance", std::to_string(c));
+
+        std::mt19937_64 a(seed), b(seed);
+        const u64 lo = b();
+        if (random_u128(a) != u128(lo, b()))
+            failures += self_test_fail("random_u128 of a 64 bit generator", std::to_string(seed));
+        std::mt19937_64 c(seed), d(seed);
+        self_test_u128_rng wide{ c };
+        if (random_u128(wide) != self_test_u128(d))
+            failures += self_test_fail("random_u128 of a u128 generator", std::to_string(seed));
+
+        for (int i = 0; i < 20; i++) {
+            pcg64_dxsm g(self_test_u128(rng), self_test_u128(rng));
+            if ((g.inc.lo & 1) == 0)
+                failures += self_test_fail("pcg64_dxsm increment", g.inc.to_string_hex());
+
+            // one output, from the state before the step
+            const pcg64_dxsm before = g;
+            u64 hi = before.state.hi;
+            hi ^= hi >> 32;
+            hi *= pcg64_dxsm::MULTIPLIER;
+            hi ^= hi >> 48;
+            if (g() != hi * (before.state.lo | 1) || g.state != before.state * u128(pcg64_dxsm::MULTIPLIER) + before.inc)
+                failures += self_test_fail("pcg64_dxsm step", before.state.to_string_hex());
+
+            pcg64_dxsm stepped = g;
+            for (u64 n = 0; n <= 300; n++) {
+                pcg64_dxsm jumped = g;
+                jumped.discard(u128(n));
+                if (jumped != stepped)
+                    failures += self_test_fail("pcg64_dxsm discard", std::to_string(n));
+                stepped();
+            }
+
+            const u128 x = self_test_u128(rng), y = self_test_u128(rng);
+            pcg64_dxsm twice = g, once = g;
+            twice.discard(x);
+            twice.discard(y);
+            once.discard(x + y);
+            pcg64_dxsm period = g;
+            period.discard(MAX);
+            period.step();
+            if (twice != once || period != g)
+                failures += self_test_fail("pcg64_dxsm discard", x.to_string_hex(), y.to_string_hex());
+        }
+
+        // the same seed on two streams
+        pcg64_dxsm s1(u128(42), u128(1)), s2(u128(42), u128(2));
+        if (s1() == s2() && s1() == s2())
+            failures += self_test_fail("pcg64_dxsm streams", "42");
+        return failures;
+    }
+
+    // x rounded to p significant bits, ties to even, as m · 2^shift with
+    // m ≤ 2ᵖ, using only integer operations.
+    inline u128 self_test_round(const u128& x, int p, int& shift) {
+        shift = std::max(bit_width(x) - p, 0);
+        if (shift == 0)
+            return x;
+        const u128 m = x >> (unsigned)shift;
+        const u128 rem = x - (m << (unsigned)shift), half = ONE << (unsigned)(shift - 1);
+        return rem > half || (rem == half && (m.lo & 1)) ? m + ONE : m;
+    }
+
+    // to_double and to_long_double against self_test_round, on random values
+    // and on values a little below, at and a little above a halfway point
+    // (2⁵³ + 1 and 2⁵³ + 3 among them), with the bits below it set or clear;
+    // from_double and from_long_double on integral and fractional values and
+    // on everything out of range.
+    inline int test_float(u64 seed = 1, int count = 20000) {
+        std::mt19937_64 rng(seed);
+        int failures = 0;
+        auto expect_double = [](const u128& x) {
+            int shift = 0;
+            const u128 m = self_test_round(x, DBL_MANT_DIG, shift);
+            return std::ldexp(static_cast<double>(m.hi) * 0x1p64 + static_cast<double>(m.lo), shift);
+        };
+        auto expect_long_double = [](const u128& x) {
+            int shift = 0;
+            const u128 m = self_test_round(x, LDBL_MANT_DIG, shift);
+            return std::ldexp(static_cast<long double>(m.hi) * 0x1p64L + static_cast<long double>(m.lo), shift);
+        };
+
+        for (int i = 0; i < count; i++) {
+            u128 x = self_test_u128(rng);
+            if (i % 2) {
+                // a p bit significant part and the halfway bit, then one more bit
+                // below it, or one less
+                const int p = i % 4 == 1 ? DBL_MANT_DIG : LDBL_MANT_DIG;
+                const unsigned below = 1 + (unsigned)(rng() % (unsigned)(128 - p));
+                const u128 top = (ONE << (unsigned)(p - 1)) | ((self_test_u128(rng) << (unsigned)(129 - p)) >> (unsigned)(129 - p));
+                const u128 off = ONE << (unsigned)(rng() % below);
+                x = ((top << 1 | ONE) << (below - 1));
+                x = rng() % 3 == 0 ? x : rng() % 2 ? x + off : x - off;
+                if (i < 8)
+                    x = u128((1ULL << 53) + (i < 4 ? 1 : 3));
+            }
+            if (to_double(x) != expect_double(x) || to_long_double(x) != expect_long_double(x))
+                failures += self_test_fail("to_double", x.to_string_hex());
+
+            // the rounded values back, exactly, or MAX when rounding reached 2¹²⁸
+            int shift = 0, long_shift = 0;
+            const u128 m = self_test_round(x, DBL_MANT_DIG, shift), long_m = self_test_round(x, LDBL_MANT_DIG, long_shift);
+            const u128 back = bit_width(m) + shift > 128 ? MAX : m << (unsigned)shift;
+            const u128 long_back = bit_width(long_m) + long_shift > 128 ? MAX : long_m << (unsigned)long_shift;
+            if (from_double(to_double(x)) != back || from_long_double(to_long_double(x)) != long_back)
+                failures += self_test_fail("from_double", x.to_string_hex());
+
+            // truncation of a fraction
+            const u64 k = self_test_u64(rng) >> 12;
+            if (from_double(static_cast<double>(k) + 0.5) != u128(k) || from_long_double(static_cast<long double>(k) + 0.75L) != u128(k))
+                failures += self_test_fail("from_double truncation", std::to_string(k));
+        }
+
+        const double inf = std::numeric_limits<double>::infinity(), nan = std::numeric_limits<double>::quiet_NaN();
+        for (double d : { 0.0, -0.0, 0.75, -1.0, -0x1p100, -inf, nan })
+            if (from_double(d) != ZERO || from_long_double(d) != ZERO)
+                failures += self_test_fail("from_double below 1", std::to_string(d));
+        for (double d : { 0x1p128, 1e300, inf })
+            if (from_double(d) != MAX || from_long_double(d) != MAX)
+                failures += self_test_fail("from_double of 2^128 or more", std::to_string(d));
+        // the largest double below 2¹²⁸, and 2¹²⁸ - 1 itself, which rounds up to 2¹²⁸
+        if (from_double(std::nextafter(0x1p128, 0.0)) != u128(0, ~0ULL << 11) || to_double(MAX) != 0x1p128)
+            failures += self_test_fail("from_double near 2^128", MAX.to_string_hex());
+        return failures;
+    }
+
+    // A random L limb value, with its top limbs zero a quarter of the time, so
+    // that divisors of every digit count occur.
+    template<size_t L>
+    inline basic_uint<L> self_test_uint(std::mt19937_64& rng) {
+        basic_uint<L> v;
+        const size_t used = rng() % 4 ? L : 1 + rng() % L;
+        for (size_t i = 0; i < used; i++)
+            v.limb[i] = self_test_u64(rng);
+        return v;
+    }
+
+    // x as an L limb value, the low 64·L bits.
+    template<size_t L>
+    inline basic_uint<L> self_test_uint_of(const self_test_number& x) {
+        basic_uint<L> v;
+        for (size_t i = 0; i < L; i++)
+            v.limb[i] = self_test_limb(x, i);
+        return v;
+    }
+
+    // Bit i of the reference number x.
+    inline bool self_test_bit(const self_test_number& x, size_t i) {
+        return i / 32 < x.size() && ((x[i / 32] >> (i % 32)) & 1) != 0;
+    }
+
+    // basic_uint<L>'s operators, mul_wide, divmod by basic_uint and u64, the
+    // bit counts, decimal output and the conversions, against the reference
+    // arithmetic.
+    template<size_t L>
+    inline int test_uint(std::mt19937_64& rng, int count) {
+        using U = basic_uint<L>;
+        const std::string name = "basic_uint<" + std::to_string(L) + ">";
+        int failures = 0;
+        for (int i = 0; i < count; i++) {
+            const U a = self_test_uint<L>(rng);
+            U b = self_test_uint<L>(rng);
+            if (rng() % 4 == 0)
+                for (size_t k = L / 2; k < L; k++)
+                    b.limb[k] = a.limb[k];      // equal top limbs, for <, and near quotients
+            const self_test_number na = self_test_number_of(a), nb = self_test_number_of(b);
+            const u64 d = self_test_u64(rng);
+            const int cmp = self_test_compare(na, nb);
+
+            const U sum = a + b, product = a * b;
+            U diff = a;
+            diff -= b;
+            if (sum != self_test_uint_of<L>(self_test_add(na, nb)) || product != self_test_uint_of<L>(self_test_mul(na, nb)) ||
+                diff + b != a || -b + a != diff || a * d != self_test_uint_of<L>(self_test_mul(na, self_test_number_of(d))) ||
+                a + d != self_test_uint_of<L>(self_test_add(na, self_test_number_of(d))) || (a - d) + d != a)
+                failures += self_test_fail((name + " + - *").c_str(), a.to_string_hex(), b.to_string_hex());
+            const basic_uint<2 * L> wide = mul_wide(a, b);
+            if (self_test_compare(self_test_number_of(wide), self_test_mul(na, nb)) != 0)
+                failures += self_test_fail((name + " mul_wide").c_str(), a.to_string_hex(), b.to_string_hex());
+            if ((a < b) != (cmp < 0) || (a == b) != (cmp == 0) || (a > b) != (cmp > 0) || (a <= b) != (cmp <= 0) ||
+                (a >= b) != (cmp >= 0) || (a != b) != (cmp != 0))
+                failures += self_test_fail((name + " compare").c_str(), a.to_string_hex(), b.to_string_hex());
+
+            if (b != U()) {
+                U r, r2 = a;
+                const U q = divmod(a, b, r);
+                r2 %= b;
+                if (!self_test_is_divmod(na, nb, self_test_number_of(q), self_test_number_of(r)) || a / b != q || r2 != r)
+                    failures += self_test_fail((name + " divmod").c_str(), a.to_string_hex(), b.to_string_hex());
+            }
+            if (d != 0) {
+                u64 r = 0;
+                const U q = divmod(a, d, r);
+                if (!self_test_is_divmod(na, self_test_number_of(d), self_test_number_of(q), self_test_number_of(r)) ||
+                    a / d != q || a % d != U(r))
+                    failures += self_test_fail((name + " divmod u64").c_str(), a.to_string_hex(), std::to_string(d));
+            }
+
+            const unsigned n = (unsigned)(rng() % (64 * L + 8));
+            bool ok = true;
+            const U left = a << n, right = a >> n;
+            for (size_t k = 0; k < 64 * L; k++)
+                ok &= self_test_bit(self_test_number_of(left), k) == (k >= n && self_test_bit(na, k - n)) &&
+                    self_test_bit(self_test_number_of(right), k) == self_test_bit(na, k + n);
+            if (!ok)
+                failures += self_test_fail((name + " shift").c_str(), a.to_string_hex(), std::to_string(n));
+            if ((a & b) + (a | b) != a + b || ((a ^ b) | (a & b)) != (a | b) || (~a & a) != U())
+                failures += self_test_fail((name + " bitwise").c_str(), a.to_string_hex(), b.to_string_hex());
+
+            int leading = 0, trailing = 0, ones = 0;
+            while (leading < 64 * (int)L && !self_test_bit(na, 64 * L - 1 - leading))
+                leading++;
+            while (trailing < 64 * (int)L && !self_test_bit(na, trailing))
+                trailing++;
+            for (size_t k = 0; k < 64 * L; k++)
+                ones += self_test_bit(na, k);
+            if (countl_zero(a) != leading || countr_zero(a) != trailing || popcount(a) != ones || bit_width(a) != 64 * (int)L - leading)
+                failures += self_test_fail((name + " bit counts").c_str(), a.to_string_hex());
+
+            // decimal digits read back with the reference arithmetic
+            self_test_number back;
+            for (char c : a.to_string())
+                back = self_test_add(self_test_mul(back, self_test_number_of(10)), self_test_number_of((u64)(c - '0')));
+            if (self_test_compare(back, na) != 0 || a.to_string_hex().size() != 2 + 16 * L)
+                failures += self_test_fail((name + " to_string").c_str(), a.to_string_hex(), a.to_string());
+
+            // zero extension and truncation
+            const basic_uint<L + 1> extended(a);
+            if (extended.limb[L] != 0 || basic_uint<L>(extended) != a || basic_uint<2>(a).limb[1] != a.limb[1])
+                failures += self_test_fail((name + " conversion").c_str(), a.to_string_hex());
+        }
+        return failures;
+    }
+
+    // basic_uint of several widths, including an odd one, all through test_uint,
+    // u256's halves, and the add back step of divmod, which the estimate needs
+    // with three or more divisor digits: u = q·v - 1 for a normalized three
+    // digit v makes the corrected estimate q while the quotient is q - 1.
+    inline int test_wide(u64 seed = 1, int count = 3000) {
+        static_assert(std::is_same<uint_n<2>, u128>::value && std::is_same<uint_n<4>, u256>::value, "uint_n");
+        std::mt19937_64 rng(seed);
+        int failures = test_uint<3>(rng, count) + test_uint<4>(rng, count) + test_uint<8>(rng, count / 4);
+
+        for (int i = 0; i < count; i++) {
+            const u128 lo = self_test_u128(rng), hi = self_test_u128(rng);
+            const u256 w(lo, hi);
+            if (w.lo() != lo || w.hi() != hi || u256(lo) != u256(lo, ZERO) || mul_wide(lo, hi) != mul128(lo, hi))
+                failures += self_test_fail("u256 halves", w.to_string_hex());
+
+            basic_uint<3> v = self_test_uint<3>(rng);
+            v.limb[2] |= 1ULL << 63;
+            const u64 q = rng() | 1;
+            const basic_uint<4> u = basic_uint<4>(v) * q - 1;
+            basic_uint<4> r;
+            if (divmod(u, basic_uint<4>(v), r) != basic_uint<4>(q - 1) || r != basic_uint<4>(v) - 1)
+                failures += self_test_fail("basic_uint divmod add back", u.to_string_hex(), v.to_string_hex());
+        }
+        return failures;
+    }
+
+    // i128: comparisons against the unsigned order with the sign bit flipped,
+    // >> bit by bit, / and % against the magnitudes' divmod with the signs of
+    // truncation, mul64s against the sign extended product, abs and to_string,
+    // and the edges at I128_MIN and I128_MAX.
+    inline int test_signed(u64 seed = 1, int count = 100000) {
+        std::mt19937_64 rng(seed);
+        int failures = 0;
+        const u128 flip(0, 1ULL << 63);
+        for (int i = 0; i < count; i++) {
+            const i128 a(self_test_u128(rng)), b(self_test_u128(rng));
+            const u128 ua(a), ub(b);
+            const bool lt = (ua ^ flip) < (ub ^ flip);
+            if ((a < b) != lt || (a > b) != (b < a) || (a <= b) != !(b < a) || (a >= b) != !lt ||
+                (a == b) != (ua == ub) || a.is_negative() != ((ua >> 127) == ONE))
+                failures += self_test_fail("i128 compare", a.to_string(), b.to_string());
+
+            const unsigned n = (unsigned)(rng() % 128);
+            const u128 shifted(a >> n);
+            bool ok = true;
+            for (int k = 0; k < 128; k++)
+                ok &= self_test_bit(shifted, k) == self_test_bit(ua, std::min(k + (int)n, 127));
+            if (!ok || (a << n) != i128(ua << n))
+                failures += self_test_fail("i128 shift", a.to_string(), std::to_string(n));
+
+            if (b != i128() && !(a == I128_MIN && b == i128(-1))) {
+                const i128 q = a / b, r = a % b;
+                i128 q2 = a, r2 = a;
+                q2 /= b;
+                r2 %= b;
+                // |a| = |q|·|b| + |r| with |r| < |b|, q negative only if the signs
+                // differ and r only if a is
+                if (!self_test_is_divmod(self_test_number_of(a.magnitude()), self_test_number_of(b.magnitude()),
+                        self_test_number_of(q.magnitude()), self_test_number_of(r.magnitude())) ||
+                    (q.is_negative() && a.is_negative() == b.is_negative()) ||
+                    (q != i128() && !q.is_negative() && a.is_negative() != b.is_negative()) ||
+                    (r != i128() && r.is_negative() != a.is_negative()) || q2 != q || r2 != r)
+                    failures += self_test_fail("i128 divmod", a.to_string(), b.to_string());
+            }
+
+            const i64 x = (i64)self_test_u64(rng), y = (i64)self_test_u64(rng);
+            if (mul64s(x, y) != i128(x) * i128(y) || i128(x).magnitude() != u128(x < 0 ? 0 - (u64)x : (u64)x))
+                failures += self_test_fail("mul64s", std::to_string(x), std::to_string(y));
+
+            if (abs(a) != (a.is_negative() ? -a : a) || (-a).magnitude() != a.magnitude() ||
+                a.to_string() != (a.is_negative() ? "-" : "") + a.magnitude().to_string())
+                failures += self_test_fail("i128 abs", a.to_string());
+        }
+
+        // the ends of the range, and truncation toward zero
+        if (I128_MIN - i128(1) != I128_MAX || I128_MIN.magnitude() != u128(0, 1ULL << 63) || abs(I128_MIN) != I128_MIN ||
+            -I128_MIN != I128_MIN || !(I128_MIN < I128_MAX) || !(I128_MIN < i128(-1)) || !(i128(-1) < i128()) ||
+            (I128_MIN >> 127) != i128(-1) || (I128_MAX >> 126) != i128(1) || (i128(-1) >> 100) != i128(-1))
+            failures += self_test_fail("i128 range", I128_MIN.to_string(), I128_MAX.to_string());
+        if (I128_MIN / i128(1) != I128_MIN || I128_MIN / I128_MIN != i128(1) || I128_MAX / I128_MIN != i128() ||
+            I128_MIN % I128_MAX != i128(-1) || I128_MIN / i128(2) != I128_MIN >> 1 || I128_MIN % i128(-1) != i128())
+            failures += self_test_fail("i128 divmod range", I128_MIN.to_string());
+        if (i128(-7) / i128(2) != i128(-3) || i128(-7) % i128(2) != i128(-1) || i128(7) / i128(-2) != i128(-3) ||
+            i128(7) % i128(-2) != i128(1) || i128(-7) / i128(-2) != i128(3) || i128(-7) % i128(-2) != i128(-1) ||
+            (i128(-7) >> 1) != i128(-4))
+            failures += self_test_fail("i128 truncation", "-7 / 2");
+        if (mul64s(INT64_MIN, INT64_MIN) != i128(0, 1ULL << 62) || mul64s(INT64_MIN, -1) != i128(1ULL << 63, 0) ||
+            mul64s(INT64_MAX, INT64_MIN) != i128(1ULL << 63, (u64)-(1LL << 62)) || mul64s(-1, -1) != i128(1))
+            failures += self_test_fail("mul64s range", "INT64_MIN");
+        if (I128_MIN.to_string() != "-170141183460469231731687303715884105728" ||
+            I128_MAX.to_string() != "170141183460469231731687303715884105727" || i128(-1).to_string() != "-1" ||
+            i128().to_string() != "0")
+            failures += self_test_fail("i128 to_string", I128_MIN.to_string());
+        return failures;
+    }
+
+    // The endian aware loads and stores, byte by byte and at every alignment,
+    // and varints against their definition: the round trip, each byte, the size
+    // at every 7 bit boundary, and the rejection of truncated and overlong input.
+    inline int test_serialization(u64 seed = 1, int count = 20000) {
+        std::mt19937_64 rng(seed);
+        int failures = 0;
+        for (int i = 0; i < count + 2 * 128; i++) {
+            // first 2ᵏ - 1 and 2ᵏ for every k, where varint_size steps at k = 7j
+            const u128 v = i < 2 * 128 ? (ONE << (unsigned)(i / 2)) - u128((u64)(i % 2 == 0)) : self_test_u128(rng);
+            std::byte buf[VARINT_MAX_BYTES + 1];
+            const std::byte* end = write_varint(buf, v);
+            const size_t size = (size_t)(end - buf);
+            int width = 1;
+            while (width < 128 && (v >> (unsigned)width) != ZERO)
+                width++;
+            bool ok = size == varint_size(v) && size == (size_t)(width + 6) / 7;
+            for (size_t k = 0; ok && k < size; k++)
+                ok = std::to_integer<u64>(buf[k]) == (((v >> (unsigned)(7 * k)).lo & 0x7F) | (k + 1 < size ? 0x80 : 0));
+            u128 back;
+            if (!ok || read_varint(buf, end, back) != end || back != v)
+                failures += self_test_fail("varint", v.to_string_hex(), std::to_string(size));
+            back = ~v;
+            if (read_varint(buf, end - 1, back) != nullptr || back != ~v || read_varint(buf, buf, back) != nullptr)
+                failures += self_test_fail("truncated varint accepted", v.to_string_hex());
+
+            // 16 bytes at each offset of a buffer, so most are unaligned
+            std::byte le[32], be[32];
+            const size_t at = (size_t)i % 17;
+            store_le(le + at, v);
+            store_be(be + at, v);
+            ok = true;
+            for (unsigned k = 0; k < 16; k++) {
+                const u64 byte = (v >> (8 * k)).lo & 0xFF;
+                ok &= std::to_integer<u64>(le[at + k]) == byte && std::to_integer<u64>(be[at + 15 - k]) == byte;
+            }
+            if (!ok || load_le(le + at) != v || load_be(be + at) != v || load_le(be + at) != byteswap(v) ||
+                byteswap(byteswap(v)) != v || bswap64(v.lo) != byteswap(u128(0, v.lo)).lo)
+                failures += self_test_fail("load/store", v.to_string_hex(), std::to_string(at));
+        }
+
+        // 0 padded to two bytes is accepted, as in protocol buffers; the 19th byte
+        // holds only bits 126 and 127, and there is no 20th.
+        const std::byte padded[] = { std::byte{ 0x80 }, std::byte{ 0 } };
+        u128 v = ONE;
+        if (read_varint(padded, padded + 2, v) != padded + 2 || v != ZERO)
+            failures += self_test_fail("padded varint", v.to_string());
+        std::byte over[VARINT_MAX_BYTES + 1];
+        for (std::byte& b : over)
+            b = std::byte{ 0xff };
+        over[VARINT_MAX_BYTES - 1] = std::byte{ 3 };
+        if (read_varint(over, over + VARINT_MAX_BYTES, v) != over + VARINT_MAX_BYTES || v != MAX ||
+            write_varint(over, MAX) != over + VARINT_MAX_BYTES || varint_size(ZERO) != 1)
+            failures += self_test_fail("varint MAX", MAX.to_string());
+        over[VARINT_MAX_BYTES - 1] = std::byte{ 4 };
+        u128 unchanged = ONE;
+        if (read_varint(over, over + VARINT_MAX_BYTES, unchanged) != nullptr || unchanged != ONE)
+            failures += self_test_fail("overlong varint accepted", "4");
+        over[VARINT_MAX_BYTES - 1] = std::byte{ 0x83 };
+        over[VARINT_MAX_BYTES] = std::byte{ 0 };
+        if (read_varint(over, over + VARINT_MAX_BYTES + 1, unchanged) != nullptr || unchanged != ONE)
+            failures += self_test_fail("overlong varint accepted", "20 bytes");
+
+        // arrays, and a short or malformed one
+        constexpr size_t n = 100;
+        u128 values[n], back[n];
+        for (u128& x : values)
+            x = self_test_u128(rng);
+        std::byte enc[n * VARINT_MAX_BYTES + 1];
+        const std::byte* end = write_varints(enc, values, n);
+        if (read_varints(enc, end, back, n) != end || !std::equal(values, values + n, back) ||
+            read_varints(enc, end - 1, back, n) != nullptr || read_varints(enc, enc, back, 0) != enc)
+            failures += self_test_fail("varints", std::to_string(n));
+        for (int order = 0; order < 2; order++) {
+            std::fill(back, back + n, ZERO);
+            if (order == 0) {
+                store_le(enc + 1, values, n);
+                load_le(enc + 1, back, n);
+            } else {
+                store_be(enc + 1, values, n);
+                load_be(enc + 1, back, n);
+            }
+            bool ok = std::equal(values, values + n, back);
+            for (size_t k = 0; k < n; k++)
+                ok &= (order == 0 ? load_le(enc + 1 + 16 * k) : load_be(enc + 1 + 16 * k)) == values[k];
+            if (!ok)
+                failures += self_test_fail("load/store arrays", order == 0 ? "le" : "be");
+        }
+        return failures;
+    }
+
+    // ilog2 and ilog10 at every power of two and ten and their neighbours, and
+    // against the decimal length; isqrt against r² ≤ x < (r + 1)² with the
+    // reference arithmetic, at k² - 1, k² and k² + 2k; ipow against repeated
+    // multiplication; gcd against Euclid's algorithm and lcm against the
+    // definition.
+    inline int test_integer(u64 seed = 1, int count = 30000) {
+        std::mt19937_64 rng(seed);
+        int failures = 0;
+        if (ilog2(ZERO) != -1 || ilog10(ZERO) != -1 || ilog2(MAX) != 127 || ilog10(MAX) != 38)
+            failures += self_test_fail("ilog of 0 and MAX", "");
+        for (int k = 0; k < 128; k++) {
+            const u128 p = ONE << (unsigned)k;
+            if (ilog2(p) != k || (k > 0 && ilog2(p - ONE) != k - 1) || ilog2(p + p - ONE) != k)
+                failures += self_test_fail("ilog2", std::to_string(k));
+        }
+        u128 p10 = ONE;
+        for (int k = 0; k < 39; k++, p10 *= 10) {
+            if (POW10.v[k] != p10 || ilog10(p10) != k || ilog10(p10 + ONE) != k || (k > 0 && ilog10(p10 - ONE) != k - 1))
+                failures += self_test_fail("ilog10", std::to_string(k));
+        }
+        if (isqrt(ZERO) != 0 || isqrt(ONE) != 1 || isqrt(u128(3)) != 1 || isqrt(u128(4)) != 2 || isqrt(MAX) != UINT64_MAX ||
+            isqrt(mul64(UINT64_MAX, UINT64_MAX)) != UINT64_MAX || isqrt(mul64(UINT64_MAX, UINT64_MAX) - ONE) != UINT64_MAX - 1)
+            failures += self_test_fail("isqrt", "corner cases");
+        if (ipow(ZERO, 0) != ONE || ipow(ZERO, 5) != ZERO || ipow(u128(2), 127) != ONE << 127 || ipow(u128(2), 128) != ZERO ||
+            ipow(u128(10), 38) != POW10.v[38] || ipow(MAX, 3) != MAX || ipow(MAX, 4) != ONE)
+            failures += self_test_fail("ipow", "corner cases");
+        if (gcd(ZERO, ZERO) != ZERO || gcd(MAX, ZERO) != MAX || gcd(ZERO, MAX) != MAX || gcd(ONE << 127, ONE << 64) != ONE << 64 ||
+            gcd(MAX, MAX - ONE) != ONE || lcm(ZERO, MAX) != ZERO || lcm(MAX, ONE) != MAX || lcm(u128(4), u128(6)) != u128(12))
+            failures += self_test_fail("gcd", "corner cases");
+
+        for (int i = 0; i < count; i++) {
+            const u128 x = self_test_u128(rng);
+            const int l2 = ilog2(x), l10 = ilog10(x);
+            if (x != ZERO && (l2 != 127 - countl_zero(x) || l10 != (int)x.to_string().size() - 1))
+                failures += self_test_fail("ilog", x.to_string_hex());
+
+            // r² ≤ x < (r + 1)², exactly, including (r + 1)² = 2¹²⁸
+            const u64 r = isqrt(x);
+            const self_test_number next = self_test_number_of(u128(r) + ONE);
+            if (mul64(r, r) > x || self_test_compare(self_test_mul(next, next), self_test_number_of(x)) <= 0)
+                failures += self_test_fail("isqrt", x.to_string_hex(), std::to_string(r));
+            // and at the edges, where the double estimate rounds the wrong way
+            const u64 k = i % 2 ? self_test_u64(rng) : (u64)1 << 32 | rng() >> 32;
+            const u128 sq = mul64(k, k);
+            if (k > 0 && (isqrt(sq) != k || isqrt(sq - ONE) != k - 1 || (k < UINT64_MAX && isqrt(sq + u128(k) + u128(k)) != k)))
+                failures += self_test_fail("isqrt at k²", std::to_string(k));
+
+            const unsigned e = (unsigned)(rng() % 300);
+            u128 power = ONE;
+            for (unsigned j = 0; j < e; j++)
+                power *= x;
+            if (ipow(x, e) != power)
+                failures += self_test_fail("ipow", x.to_string_hex(), std::to_string(e));
+
+            // with a common factor half the time, so the result is not mostly 1
+            u128 a = x, b = self_test_u128(rng);
+            if (i % 2) {
+                const u128 g = u128(rng() >> (rng() % 64)) << (unsigned)(rng() % 32);
+                a = (a >> 64) * g;
+                b = (b >> 64) * g;
+            }
+            u128 ea = a, eb = b;
+            while (eb != ZERO) {
+                const u128 t = ea % eb;
+                ea = eb;
+                eb = t;
+            }
+            const u128 g = gcd(a, b);
+            if (g != ea || gcd(b, a) != g)
+                failures += self_test_fail("gcd", a.to_string_hex(), b.to_string_hex());
+            if (a != ZERO && b != ZERO) {
+                const checked_result exact = checked_mul(a / g, b);
+                if (exact.overflow ? lcm(a, b) != a / g * b : (lcm(a, b) % a != ZERO || lcm(a, b) % b != ZERO ||
+                        lcm(a, b) * g != a * b))
+                    failures += self_test_fail("lcm", a.to_string_hex(), b.to_string_hex());
+            }
+        }
+        return failures;
+    }
+
+    // All of the above; 0 if every check passed.
+    inline int self_test(u64 seed = 1) {
+        return test_division(seed) + test_arithmetic(seed) + test_text(seed) + test_bits(seed) +
+            test_shifts(seed) + test_montgomery(seed) + test_constant_division(seed) +
+            test_checked(seed) + test_accumulate(seed) + test_hash(seed) + test_random(seed) +
+            test_float(seed) + test_wide(seed) + test_signed(seed) +
+            test_serialization(seed) + test_integer(seed);
+    }
+#endif
+
+
+} // namespace U128
 
 // A couple quick checks to perform at compile-time
 static_assert(u128::u128(1) << 64 == u128::u128(0, 1), "Shift failed");
-//static_assert((U128::u128(1) * U128::u128(1, 0)) == U128::u128(0, 1), "Mul failed"); // can't use. Multiplies are not constexpr.
+#if U128_HAS_CONSTEXPR_ARITH
+static_assert(u128::u128(1ULL << 32) * u128::u128(1ULL << 32) == u128::u128(0, 1), "Mul failed");
+static_assert(u128::u128(0, 1) / 3 == u128::u128(0x5555555555555555ULL), "Div failed");
+static_assert(u128::to_double(u128::u128(1, 1ULL << 52)) == 0x1p116, "to_double failed");
+static_assert(u128::mul64s(-3, INT64_MIN) == u128::i128(0x8000000000000000ULL, 1), "mul64s failed");
+#endif
 
 // extend std::hash
 namespace std {
     template<> struct hash<u128::u128> {
         size_t operator()(const u128::u128& v) const noexcept {
-            auto h1 = std::hash<uint64_t>{}(v.lo);
-            auto h2 = std::hash<uint64_t>{}(v.hi);
-            return h1 ^ (h2 + 0x9e3779b9ULL + (h1 << 6) + (h1 >> 2));
+            return static_cast<size_t>(u128::hash128(v));
+        }
+    };
+    template<> struct hash<u128::i128> {
+        size_t operator()(const u128::i128& v) const noexcept {
+            return static_cast<size_t>(u128::hash128(u128::u128(v)));
         }
     };
 }
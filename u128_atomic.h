@@ -0,0 +1,293 @@
+#pragma once
+// file u128_atomic.h
+
+// class u128_atomic
+//      A 128 bit atomic built directly on the double width compare-and-swap:
+//      lock cmpxchg16b on x86-64, CASP (ARMv8.1 LSE) or an LDAXP/STLXP loop on
+//      AArch64, and _InterlockedCompareExchange128 on MSVC. std::atomic<u128>
+//      usually falls back to a lock instead, since the plain x86-64 ABI cannot
+//      assume cmpxchg16b.
+//
+//      load, store, exchange, compare_exchange_weak/strong, fetch_add,
+//      fetch_sub, fetch_and, fetch_or, fetch_xor. Every operation is
+//      sequentially consistent.
+//
+// u128_atomic::is_always_lock_free
+//      True where one of the above is available. Elsewhere u128_atomic wraps
+//      std::atomic<u128>, with whatever that does (with GCC, linking
+//      libatomic).
+//
+// x86-64 processors without cmpxchg16b (the first AMD64 models, before 2006)
+// are not supported.
+//
+// int test_atomic(u64 seed = 1)
+//      With U128_SELF_TEST, checks every operation against plain u128
+//      arithmetic, and concurrent updates from several threads; returns the
+//      number of failures.
+
+#include "u128.h"
+
+#include <atomic>
+
+#if U128_SELF_TEST
+#include <thread>
+#include <vector>
+#endif
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+#include <intrin.h>   // for _InterlockedCompareExchange128
+#define U128_ATOMIC_MSVC 1
+#elif defined(__GNUC__) && defined(__x86_64__)
+#define U128_ATOMIC_CMPXCHG16B 1
+#elif defined(__GNUC__) && defined(__aarch64__) && !defined(__AARCH64EB__)
+#define U128_ATOMIC_AARCH64 1
+#endif
+
+#if defined(U128_ATOMIC_MSVC) || defined(U128_ATOMIC_CMPXCHG16B) || defined(U128_ATOMIC_AARCH64)
+#define U128_ATOMIC_LOCK_FREE 1
+#else
+#define U128_ATOMIC_LOCK_FREE 0
+#endif
+
+
+namespace u128 {
+
+    class u128_atomic {
+    public:
+        static constexpr bool is_always_lock_free = U128_ATOMIC_LOCK_FREE != 0;
+
+        u128_atomic() noexcept = default;
+        // value_ is mutable, so even a constant initialized const instance is
+        // never placed in read-only memory, where load() (a cmpxchg) would fault.
+        constexpr u128_atomic(const u128& v) noexcept : value_(v) {}
+        u128_atomic(const u128_atomic&) = delete;
+        u128_atomic& operator=(const u128_atomic&) = delete;
+
+        bool is_lock_free() const noexcept { return is_always_lock_free; }
+
+        // On x86-64 this is a cmpxchg16b as well (there is no plain 16 byte
+        // atomic load), so it needs the cache line in exclusive state: prefer
+        // operations that return the old value over a load before them.
+        u128 load() const noexcept {
+#if U128_ATOMIC_LOCK_FREE
+            u128 v;
+            cas(v, v);  // writes back v if it matches
+            return v;
+#else
+            return value_.load();
+#endif
+        }
+
+        void store(const u128& desired) noexcept { exchange(desired); }
+
+        u128 exchange(const u128& desired) noexcept {
+            return update([&](const u128&) { return desired; });
+        }
+
+        // Replaces the value with desired if it equals expected, and returns
+        // true. Otherwise loads the value into expected and returns false.
+        bool compare_exchange_strong(u128& expected, const u128& desired) noexcept {
+#if U128_ATOMIC_LOCK_FREE
+            return cas(expected, desired);
+#else
+            return value_.compare_exchange_strong(expected, desired);
+#endif
+        }
+
+        // Never fails spuriously here, but callers that loop anyway should use
+        // it, as with std::atomic.
+        bool compare_exchange_weak(u128& expected, const u128& desired) noexcept {
+            return compare_exchange_strong(expected, desired);
+        }
+
+        // Each returns the value from before the operation.
+        u128 fetch_add(const u128& v) noexcept { return update([&](const u128& old) { return old + v; }); }
+        u128 fetch_sub(const u128& v) noexcept { return update([&](const u128& old) { return old - v; }); }
+        u128 fetch_and(const u128& v) noexcept { return update([&](const u128& old) { return old & v; }); }
+        u128 fetch_or(const u128& v) noexcept { return update([&](const u128& old) { return old | v; }); }
+        u128 fetch_xor(const u128& v) noexcept { return update([&](const u128& old) { return old ^ v; }); }
+
+        operator u128() const noexcept { return load(); }
+        u128 operator=(const u128& desired) noexcept { store(desired); return desired; }
+        u128 operator+=(const u128& v) noexcept { return fetch_add(v) + v; }
+        u128 operator-=(const u128& v) noexcept { return fetch_sub(v) - v; }
+        u128 operator&=(const u128& v) noexcept { return fetch_and(v) & v; }
+        u128 operator|=(const u128& v) noexcept { return fetch_or(v) | v; }
+        u128 operator^=(const u128& v) noexcept { return fetch_xor(v) ^ v; }
+        u128 operator++() noexcept { return fetch_add(ONE) + ONE; }
+        u128 operator++(int) noexcept { return fetch_add(ONE); }
+        u128 operator--() noexcept { return fetch_sub(ONE) - ONE; }
+        u128 operator--(int) noexcept { return fetch_sub(ONE); }
+
+    private:
+        // Replaces the value with f(value) in a compare-and-swap loop and
+        // returns the old value.
+        template<typename F>
+        u128 update(F f) noexcept {
+            u128 old = guess();
+            while (!compare_exchange_weak(old, f(old))) {
+            }
+            return old;
+        }
+
+#if U128_ATOMIC_LOCK_FREE
+        // The first expected value of a compare-and-swap loop. Two separate
+        // 64 bit loads may tear, but then the compare-and-swap just fails and
+        // supplies the real value, and they are much cheaper than load().
+        u128 guess() const noexcept {
+#if defined(U128_ATOMIC_MSVC)
+            const volatile u64* p = &value_.lo;
+            return u128(p[0], p[1]);
+#else
+            return u128(__atomic_load_n(&value_.lo, __ATOMIC_RELAXED), __atomic_load_n(&value_.hi, __ATOMIC_RELAXED));
+#endif
+        }
+
+        bool cas(u128& expected, const u128& desired) const noexcept {
+#if defined(U128_ATOMIC_MSVC)
+            // Writes the old value to the comparand array, lo first, in any case.
+            return _InterlockedCompareExchange128(reinterpret_cast<volatile __int64*>(&value_.lo),
+                (__int64)desired.hi, (__int64)desired.lo, reinterpret_cast<__int64*>(&expected.lo)) != 0;
+
+#elif defined(U128_ATOMIC_CMPXCHG16B)
+            // Compares rdx:rax with the memory; if equal stores rcx:rbx and sets
+            // ZF, otherwise loads the memory into rdx:rax.
+            bool ok;
+            __asm__ __volatile__("lock cmpxchg16b %1"
+                : "=@ccz"(ok), "+m"(value_), "+a"(expected.lo), "+d"(expected.hi)
+                : "b"(desired.lo), "c"(desired.hi)
+                : "memory");
+            return ok;
+
+#elif defined(__ARM_FEATURE_ATOMICS)
+            // CASPAL needs each pair in consecutive registers, starting even.
+            register u64 x0 __asm__("x0") = expected.lo;
+            register u64 x1 __asm__("x1") = expected.hi;
+            register u64 x2 __asm__("x2") = desired.lo;
+            register u64 x3 __asm__("x3") = desired.hi;
+            __asm__ __volatile__("caspal %0, %1, %3, %4, %2"
+                : "+r"(x0), "+r"(x1), "+Q"(value_)
+                : "r"(x2), "r"(x3)
+                : "memory");
+            const bool ok = x0 == expected.lo && x1 == expected.hi;
+            expected = u128(x0, x1);
+            return ok;
+
+#else
+            // ARMv8.0: a pair load is only single-copy atomic if the matching
+            // store exclusive succeeds, so a mismatch stores back what it read
+            // (retrying if that fails) before reporting it.
+            u64 lo, hi;
+            unsigned failed;
+            __asm__ __volatile__(
+                "1: ldaxp %0, %1, %3\n"
+                "   cmp %0, %4\n"
+                "   ccmp %1, %5, #0, eq\n"
+                "   b.ne 2f\n"
+                "   stlxp %w2, %6, %7, %3\n"
+                "   cbnz %w2, 1b\n"
+                "   b 3f\n"
+                "2: stlxp %w2, %0, %1, %3\n"
+                "   cbnz %w2, 1b\n"
+                "3:"
+                : "=&r"(lo), "=&r"(hi), "=&r"(failed), "+Q"(value_)
+                : "r"(expected.lo), "r"(expected.hi), "r"(desired.lo), "r"(desired.hi)
+                : "cc", "memory");
+            const bool ok = lo == expected.lo && hi == expected.hi;
+            expected = u128(lo, hi);
+            return ok;
+#endif
+        }
+
+        alignas(16) mutable u128 value_;
+#else
+        u128 guess() const noexcept { return value_.load(std::memory_order_relaxed); }
+
+        std::atomic<u128> value_;
+#endif
+    };
+
+
+#if U128_SELF_TEST
+
+    // -----------------------------------------------------------------------------
+    // Self test
+    // -----------------------------------------------------------------------------
+
+    // load() of a const static instance, every operation against the same
+    // operation on a plain u128 (both outcomes of compare_exchange), then four
+    // threads doing fetch_add of a value that carries into hi, and a
+    // compare-and-swap loop, checked against the expected total.
+    inline int test_atomic(u64 seed = 1) {
+        std::mt19937_64 rng(seed);
+        int failures = 0;
+
+        static const u128_atomic constant(u128(5, 7));
+        if (constant.load() != u128(5, 7) || u128(constant) != u128(5, 7))
+            failures += self_test_fail("u128_atomic const load", constant.load().to_string());
+
+        u128 plain = self_test_u128(rng);
+        u128_atomic a(plain);
+        for (int i = 0; i < 10000; i++) {
+            const u128 v = self_test_u128(rng);
+            const u128 before = plain;
+            u128 old, expected;
+            bool ok = true;
+            switch (rng() % 11) {
+            case 0: old = a.fetch_add(v); plain += v; break;
+            case 1: old = a.fetch_sub(v); plain -= v; break;
+            case 2: old = a.fetch_and(v); plain &= v; break;
+            case 3: old = a.fetch_or(v); plain |= v; break;
+            case 4: old = a.fetch_xor(v); plain ^= v; break;
+            case 5: old = a.exchange(v); plain = v; break;
+            case 6: a.store(v); old = before; plain = v; break;
+            case 7: old = a++; plain += ONE; break;
+            case 8: old = a--; plain -= ONE; break;
+            case 9:
+                expected = before;
+                ok = a.compare_exchange_strong(expected, v);
+                old = expected;
+                plain = v;
+                break;
+            default:
+                expected = ~before;
+                ok = !a.compare_exchange_strong(expected, v);
+                old = expected;
+                break;
+            }
+            if (!ok || old != before || a.load() != plain)
+                failures += self_test_fail("u128_atomic", before.to_string(), v.to_string());
+        }
+
+        // the threads wait for each other so that they actually overlap
+        constexpr int threads = 4, adds = 100000;
+        const u128 step(UINT64_MAX, 1);
+        u128_atomic shared(ZERO);
+        std::atomic<int> ready(0);
+        std::vector<std::thread> pool;
+        for (int t = 0; t < threads; t++) {
+            pool.emplace_back([&shared, &step, &ready, t]() {
+                ready.fetch_add(1);
+                while (ready.load() < threads) {
+                }
+                for (int i = 0; i < adds; i++) {
+                    if ((i + t) % 2 == 0) {
+                        shared.fetch_add(step);
+                    } else {
+                        u128 old = shared.load();
+                        while (!shared.compare_exchange_weak(old, old + step)) {
+                        }
+                    }
+                }
+            });
+        }
+        for (std::thread& t : pool)
+            t.join();
+        if (shared.load() != step * u128(u64(threads) * adds))
+            failures += self_test_fail("u128_atomic threads", shared.load().to_string());
+        return failures;
+    }
+
+#endif
+
+} // namespace u128
@@ -0,0 +1,549 @@
+#pragma once
+// file u128_column.h
+
+// class u128_column
+//      A growable array of u128 stored as a structure of arrays: all lo limbs in
+//      one 64 byte aligned buffer, all hi limbs in another. Most bulk work on
+//      u128 keys touches one limb at a time (range filters decide on the hi
+//      word, carries only move lo → hi), and with the limbs apart that work
+//      streams half the bytes and vectorizes without shuffles.
+//
+//      Elements are read and written as u128 through get/set, operator[] (a
+//      proxy reference) and random access iterators; lo_data()/hi_data() expose
+//      the limb arrays directly.
+//
+// void add_n(const u128_column& a, const u128_column& b, u128_column& out)
+// void xor_n(const u128_column& a, const u128_column& b, u128_column& out)
+// void cmp_lt_n(const u128_column& a, const u128_column& b, bool* out)
+//      The u128_simd.h kernels, on columns of equal size. add_n and xor_n resize
+//      out to fit; cmp_lt_n writes a.size() results to out, which must have room.
+//
+// void hash_n(const u128_column& keys, size_t* out, u64 seed = 0)
+//      out[i] = hash128(keys[i], seed)
+//
+// size_t count_in_range(const u128_column& c, u128 first, u128 last)
+//      The number of elements in [first, last).
+//
+// size_t select_in_range(const u128_column& c, u128 first, u128 last, size_t* out)
+//      Writes the indices of the elements in [first, last) to out, which must
+//      have room for c.size(), and returns how many there are.
+//
+// int test_column(u64 seed = 1)
+//      With U128_SELF_TEST, checks the container, its iterators and the kernels
+//      and scans above against a std::vector<u128>; returns the number of failures.
+
+#include "u128.h"
+#include "u128_simd.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <new>
+#include <utility>
+
+
+namespace u128 {
+
+    class u128_column {
+    public:
+        static constexpr size_t alignment = 64;
+
+        class reference;
+        template<bool Const> class basic_iterator;
+        using value_type = u128;
+        using size_type = size_t;
+        using iterator = basic_iterator<false>;
+        using const_iterator = basic_iterator<true>;
+
+        u128_column() noexcept = default;
+        explicit u128_column(size_t n) { resize(n); }
+        u128_column(const u128* first, size_t n) {
+            reserve(n);
+            for (size_t i = 0; i < n; i++) {
+                lo_[i] = first[i].lo;
+                hi_[i] = first[i].hi;
+            }
+            size_ = n;
+        }
+        u128_column(const u128_column& other) : u128_column() {
+            reserve(other.size_);
+            std::copy_n(other.lo_, other.size_, lo_);
+            std::copy_n(other.hi_, other.size_, hi_);
+            size_ = other.size_;
+        }
+        u128_column(u128_column&& other) noexcept
+            : lo_(std::exchange(other.lo_, nullptr)), hi_(std::exchange(other.hi_, nullptr)),
+              size_(std::exchange(other.size_, 0)), capacity_(std::exchange(other.capacity_, 0)) {}
+        u128_column& operator=(u128_column other) noexcept {
+            swap(other);
+            return *this;
+        }
+        ~u128_column() {
+            release(lo_);
+            release(hi_);
+        }
+
+        void swap(u128_column& other) noexcept {
+            std::swap(lo_, other.lo_);
+            std::swap(hi_, other.hi_);
+            std::swap(size_, other.size_);
+            std::swap(capacity_, other.capacity_);
+        }
+
+        size_t size() const noexcept { return size_; }
+        size_t capacity() const noexcept { return capacity_; }
+        bool empty() const noexcept { return size_ == 0; }
+
+        // Capacities grow geometrically, in whole cache lines of limbs.
+        void reserve(size_t n) {
+            if (n <= capacity_)
+                return;
+            const size_t per_line = alignment / sizeof(u64);
+            n = std::max((n + per_line - 1) / per_line * per_line, 2 * capacity_);
+            u64* lo = allocate(n);
+            u64* hi;
+            try {
+                hi = allocate(n);
+            }
+            catch (...) {
+                release(lo);
+                throw;
+            }
+            std::copy_n(lo_, size_, lo);
+            std::copy_n(hi_, size_, hi);
+            release(lo_);
+            release(hi_);
+            lo_ = lo;
+            hi_ = hi;
+            capacity_ = n;
+        }
+
+        // New elements are zero.
+        void resize(size_t n) {
+            reserve(n);
+            if (n > size_) {
+                std::fill(lo_ + size_, lo_ + n, 0);
+                std::fill(hi_ + size_, hi_ + n, 0);
+            }
+            size_ = n;
+        }
+        void clear() noexcept { size_ = 0; }
+
+        void push_back(u128 v) {
+            if (size_ == capacity_)
+                reserve(size_ + 1);
+            lo_[size_] = v.lo;
+            hi_[size_] = v.hi;
+            size_++;
+        }
+
+        u128 get(size_t i) const noexcept { assert(i < size_); return u128{ lo_[i], hi_[i] }; }
+        void set(size_t i, u128 v) noexcept { assert(i < size_); lo_[i] = v.lo; hi_[i] = v.hi; }
+
+        reference operator[](size_t i) noexcept { assert(i < size_); return reference(lo_ + i, hi_ + i); }
+        u128 operator[](size_t i) const noexcept { return get(i); }
+
+        u64* lo_data() noexcept { return lo_; }
+        u64* hi_data() noexcept { return hi_; }
+        const u64* lo_data() const noexcept { return lo_; }
+        const u64* hi_data() const noexcept { return hi_; }
+
+        iterator begin() noexcept { return iterator(lo_, hi_); }
+        iterator end() noexcept { return iterator(lo_ + size_, hi_ + size_); }
+        const_iterator begin() const noexcept { return const_iterator(lo_, hi_); }
+        const_iterator end() const noexcept { return const_iterator(lo_ + size_, hi_ + size_); }
+        const_iterator cbegin() const noexcept { return begin(); }
+        const_iterator cend() const noexcept { return end(); }
+
+        // Stands in for u128& to one element: converts to u128 and assigns from it.
+        class reference {
+        public:
+            operator u128() const noexcept { return u128{ *lo_, *hi_ }; }
+            reference& operator=(u128 v) noexcept {
+                *lo_ = v.lo;
+                *hi_ = v.hi;
+                return *this;
+            }
+            reference& operator=(const reference& other) noexcept { return *this = u128(other); }
+
+            // u128 compares with members, which do not convert their left operand
+            friend bool operator==(const reference& a, const reference& b) noexcept { return u128(a) == u128(b); }
+            friend bool operator!=(const reference& a, const reference& b) noexcept { return u128(a) != u128(b); }
+            friend bool operator<(const reference& a, const reference& b) noexcept { return u128(a) < u128(b); }
+            friend bool operator>(const reference& a, const reference& b) noexcept { return u128(a) > u128(b); }
+            friend bool operator<=(const reference& a, const reference& b) noexcept { return u128(a) <= u128(b); }
+            friend bool operator>=(const reference& a, const reference& b) noexcept { return u128(a) >= u128(b); }
+            friend bool operator==(const reference& a, const u128& b) noexcept { return u128(a) == u128(b); }
+            friend bool operator!=(const reference& a, const u128& b) noexcept { return u128(a) != u128(b); }
+            friend bool operator<(const reference& a, const u128& b) noexcept { return u128(a) < u128(b); }
+            friend bool operator>(const reference& a, const u128& b) noexcept { return u128(a) > u128(b); }
+            friend bool operator<=(const reference& a, const u128& b) noexcept { return u128(a) <= u128(b); }
+            friend bool operator>=(const reference& a, const u128& b) noexcept { return u128(a) >= u128(b); }
+            friend bool operator==(const u128& a, const reference& b) noexcept { return u128(a) == u128(b); }
+            friend bool operator!=(const u128& a, const reference& b) noexcept { return u128(a) != u128(b); }
+            friend bool operator<(const u128& a, const reference& b) noexcept { return u128(a) < u128(b); }
+            friend bool operator>(const u128& a, const reference& b) noexcept { return u128(a) > u128(b); }
+            friend bool operator<=(const u128& a, const reference& b) noexcept { return u128(a) <= u128(b); }
+            friend bool operator>=(const u128& a, const reference& b) noexcept { return u128(a) >= u128(b); }
+
+            friend void swap(reference a, reference b) noexcept {
+                std::swap(*a.lo_, *b.lo_);
+                std::swap(*a.hi_, *b.hi_);
+            }
+
+        private:
+            friend class u128_column;
+            template<bool> friend class basic_iterator;
+            reference(u64* lo, u64* hi) noexcept : lo_(lo), hi_(hi) {}
+            u64* lo_;
+            u64* hi_;
+        };
+
+        // Random access over both limb arrays in step. Dereferencing yields a
+        // reference proxy (or, for const_iterator, a u128 value) rather than a
+        // real u128&, which the standard algorithms accept in practice (sort,
+        // lower_bound, copy, ...) although strictly only C++20 allows it.
+        template<bool Const>
+        class basic_iterator {
+            using limb = typename std::conditional<Const, const u64, u64>::type;
+
+        public:
+            using iterator_category = std::random_access_iterator_tag;
+            using value_type = u128;
+            using difference_type = std::ptrdiff_t;
+            using reference = typename std::conditional<Const, u128, u128_column::reference>::type;
+            using pointer = void;
+
+            basic_iterator() noexcept = default;
+            template<bool C = Const, typename std::enable_if<C, int>::type = 0>
+            basic_iterator(const basic_iterator<false>& other) noexcept : lo_(other.lo_), hi_(other.hi_) {}
+
+            reference operator*() const noexcept { return make(lo_, hi_); }
+            reference operator[](difference_type n) const noexcept { return make(lo_ + n, hi_ + n); }
+
+            basic_iterator& operator++() noexcept { ++lo_; ++hi_; return *this; }
+            basic_iterator& operator--() noexcept { --lo_; --hi_; return *this; }
+            basic_iterator operator++(int) noexcept { basic_iterator t = *this; ++*this; return t; }
+            basic_iterator operator--(int) noexcept { basic_iterator t = *this; --*this; return t; }
+            basic_iterator& operator+=(difference_type n) noexcept { lo_ += n; hi_ += n; return *this; }
+            basic_iterator& operator-=(difference_type n) noexcept { lo_ -= n; hi_ -= n; return *this; }
+
+            friend basic_iterator operator+(basic_iterator it, difference_type n) noexcept { return it += n; }
+            friend basic_iterator operator+(difference_type n, basic_iterator it) noexcept { return it += n; }
+            friend basic_iterator operator-(basic_iterator it, difference_type n) noexcept { return it -= n; }
+            friend difference_type operator-(const basic_iterator& a, const basic_iterator& b) noexcept { return a.lo_ - b.lo_; }
+
+            friend bool operator==(const basic_iterator& a, const basic_iterator& b) noexcept { return a.lo_ == b.lo_; }
+            friend bool operator!=(const basic_iterator& a, const basic_iterator& b) noexcept { return a.lo_ != b.lo_; }
+            friend bool operator<(const basic_iterator& a, const basic_iterator& b) noexcept { return a.lo_ < b.lo_; }
+            friend bool operator>(const basic_iterator& a, const basic_iterator& b) noexcept { return a.lo_ > b.lo_; }
+            friend bool operator<=(const basic_iterator& a, const basic_iterator& b) noexcept { return a.lo_ <= b.lo_; }
+            friend bool operator>=(const basic_iterator& a, const basic_iterator& b) noexcept { return a.lo_ >= b.lo_; }
+
+        private:
+            friend class u128_column;
+            friend class basic_iterator<true>;
+            basic_iterator(limb* lo, limb* hi) noexcept : lo_(lo), hi_(hi) {}
+
+            static u128 make(const u64* lo, const u64* hi) noexcept { return u128{ *lo, *hi }; }
+            static u128_column::reference make(u64* lo, u64* hi) noexcept { return u128_column::reference(lo, hi); }
+
+            limb* lo_ = nullptr;
+            limb* hi_ = nullptr;
+        };
+
+    private:
+        static u64* allocate(size_t n) {
+            return static_cast<u64*>(::operator new(n * sizeof(u64), std::align_val_t(alignment)));
+        }
+        static void release(u64* p) noexcept {
+            if (p)
+                ::operator delete(p, std::align_val_t(alignment));
+        }
+
+        u64* lo_ = nullptr;
+        u64* hi_ = nullptr;
+        size_t size_ = 0;
+        size_t capacity_ = 0;
+    };
+
+    inline void swap(u128_column& a, u128_column& b) noexcept { a.swap(b); }
+
+
+    // -----------------------------------------------------------------------------
+    // Batch kernels on columns
+    // -----------------------------------------------------------------------------
+
+    inline void add_n(const u128_column& a, const u128_column& b, u128_column& out) {
+        assert(a.size() == b.size());
+        out.resize(a.size());
+        add_n_soa(a.lo_data(), a.hi_data(), b.lo_data(), b.hi_data(), out.lo_data(), out.hi_data(), a.size());
+    }
+
+    // Limbs do not interact, so this is two plain loops that vectorize for the
+    // baseline target; there is no gain in dispatching.
+    inline void xor_n(const u128_column& a, const u128_column& b, u128_column& out) {
+        assert(a.size() == b.size());
+        const size_t n = a.size();
+        out.resize(n);
+        for (size_t i = 0; i < n; i++)
+            out.lo_data()[i] = a.lo_data()[i] ^ b.lo_data()[i];
+        for (size_t i = 0; i < n; i++)
+            out.hi_data()[i] = a.hi_data()[i] ^ b.hi_data()[i];
+    }
+
+    inline void cmp_lt_n(const u128_column& a, const u128_column& b, bool* out) noexcept {
+        assert(a.size() == b.size());
+        cmp_lt_n_soa(a.lo_data(), a.hi_data(), b.lo_data(), b.hi_data(), out, a.size());
+    }
+
+
+    inline void hash_n(const u128_column& keys, size_t* out, u64 seed = 0) noexcept {
+        const u64 mixed = hash_mix_seed(seed);
+        for (size_t i = 0; i < keys.size(); i++)
+            out[i] = static_cast<size_t>(hash128_mixed(u128{ keys.lo_data()[i], keys.hi_data()[i] }, mixed));
+    }
+
+
+    // -----------------------------------------------------------------------------
+    // Range scans
+    // -----------------------------------------------------------------------------
+    //
+    // Both decide on the hi word alone whenever it lies strictly between
+    // first.hi and last.hi (inside) or outside [first.hi, last.hi] (outside);
+    // only elements whose hi word equals a bound load their lo word. For keys
+    // spread over the range that is rare, so a scan reads little more than the
+    // hi array, half the bytes of an array of u128.
+
+    // Whether lo completes an element whose hi word equals a bound of [first, last).
+    inline bool in_range_on_bound(u64 hi, u64 lo, u128 first, u128 last) noexcept {
+        return u128{ lo, hi } >= first && u128{ lo, hi } < last;
+    }
+
+    inline size_t count_in_range(const u128_column& c, u128 first, u128 last) noexcept {
+        if (!(first < last))
+            return 0;
+        const u64* lo = c.lo_data();
+        const u64* hi = c.hi_data();
+        const size_t n = c.size();
+        // With d = hi - first.hi (mod 2⁶⁴), an element is on a bound if d is 0
+        // or span, and otherwise inside exactly if d < span.
+        const u64 span = last.hi - first.hi;
+        size_t count = 0;
+        for (size_t i = 0; i < n; i++) {
+            const u64 d = hi[i] - first.hi;
+            if (d == 0 || d == span)
+                count += in_range_on_bound(hi[i], lo[i], first, last);
+            else
+                count += d < span;
+        }
+        return count;
+    }
+
+    inline size_t select_in_range(const u128_column& c, u128 first, u128 last, size_t* out) noexcept {
+        if (!(first < last))
+            return 0;
+        const u64* lo = c.lo_data();
+        const u64* hi = c.hi_data();
+        const size_t n = c.size();
+        const u64 span = last.hi - first.hi;
+        size_t k = 0;
+        for (size_t i = 0; i < n; i++) {
+            const u64 d = hi[i] - first.hi;
+            // Write unconditionally and advance only on a match, so the only
+            // branch is the rarely taken one to the bounds.
+            out[k] = i;
+            if (d == 0 || d == span)
+                k += in_range_on_bound(hi[i], lo[i], first, last);
+            else
+                k += d < span;
+        }
+        return k;
+    }
+
+
+#if U128_SELF_TEST
+
+    // -----------------------------------------------------------------------------
+    // Self test
+    // -----------------------------------------------------------------------------
+
+    // u128_column against a std::vector<u128> holding the same elements: the
+    // proxy reference, iterator arithmetic and std::sort / std::lower_bound
+    // through the iterators, growth, copies and moves, the column kernels, and
+    // the range scans for bounds whose hi words are equal, adjacent or apart,
+    // with every element's hi word on or next to one of them.
+    inline int test_column(u64 seed = 1) {
+        std::mt19937_64 rng(seed);
+        int failures = 0;
+        auto aligned = [](const u128_column& c) {
+            return reinterpret_cast<std::uintptr_t>(c.lo_data()) % u128_column::alignment == 0 &&
+                reinterpret_cast<std::uintptr_t>(c.hi_data()) % u128_column::alignment == 0;
+        };
+        auto same = [](const u128_column& c, const std::vector<u128>& v) {
+            if (c.size() != v.size() || c.capacity() < c.size())
+                return false;
+            for (size_t i = 0; i < v.size(); i++)
+                if (c.get(i) != v[i] || c[i] != v[i] || c.begin()[(std::ptrdiff_t)i] != v[i])
+                    return false;
+            return std::equal(c.begin(), c.end(), v.begin()) && std::equal(c.cbegin(), c.cend(), v.begin());
+        };
+
+        for (size_t n : { 0, 1, 7, 8, 9, 63, 200 }) {
+            const std::string what = std::to_string(n);
+            std::vector<u128> v(n);
+            for (u128& x : v)
+                x = self_test_u128(rng);
+
+            // growth: push_back, reserve and resize keep the elements and the alignment
+            u128_column c;
+            for (const u128& x : v)
+                c.push_back(x);
+            if (!same(c, v) || (n && !aligned(c)) || c.empty() != (n == 0))
+                failures += self_test_fail("u128_column push_back", what);
+            c.reserve(n + 100);
+            if (!same(c, v) || c.capacity() < n + 100 || c.capacity() % 8 != 0 || !aligned(c))
+                failures += self_test_fail("u128_column reserve", what);
+            const size_t capacity = c.capacity();
+            c.reserve(1);
+            c.resize(n + 3);
+            v.resize(n + 3);
+            if (!same(c, v) || c.capacity() != capacity)
+                failures += self_test_fail("u128_column resize", what);
+            c.resize(n);
+            v.resize(n);
+
+            // copies are deep; a move leaves the source empty
+            u128_column copy(c);
+            u128_column assigned;
+            assigned = c;
+            if (!same(copy, v) || !same(assigned, v) || (n && (copy.lo_data() == c.lo_data() || !aligned(copy))))
+                failures += self_test_fail("u128_column copy", what);
+            if (n) {
+                copy.set(0, ~v[0]);
+                if (c.get(0) != v[0])
+                    failures += self_test_fail("u128_column copy is shallow", what);
+            }
+            u128_column moved(std::move(assigned));
+            u128_column move_assigned;
+            move_assigned = std::move(moved);
+            if (!same(move_assigned, v) || !moved.empty() || !assigned.empty())
+                failures += self_test_fail("u128_column move", what);
+            const u128_column from_array(v.data(), n);
+            if (!same(from_array, v))
+                failures += self_test_fail("u128_column(first, n)", what);
+
+            // iterator arithmetic
+            bool ok = c.end() - c.begin() == (std::ptrdiff_t)n && c.cend() - c.cbegin() == (std::ptrdiff_t)n;
+            for (size_t i = 0; i < n; i++) {
+                u128_column::iterator it = c.begin() + (std::ptrdiff_t)i, back = c.end() - (std::ptrdiff_t)(n - i);
+                const u128_column::const_iterator cit = it;
+                ok &= it == back && !(it != back) && it <= back && it >= back && cit == c.cbegin() + (std::ptrdiff_t)i;
+                ok &= *it == v[i] && *cit == v[i] && it - c.begin() == (std::ptrdiff_t)i;
+                ok &= (std::ptrdiff_t)i + c.begin() == it && it < c.end() && c.end() > it;
+                u128_column::iterator step = it;
+                ok &= *step++ == v[i] && step == it + 1 && *--step == v[i];
+                step += 1;
+                step -= 1;
+                ok &= step == it;
+            }
+            if (!ok)
+                failures += self_test_fail("u128_column iterators", what);
+
+            // the proxy reference: assignment from u128 and from another element,
+            // swap, and comparisons in both directions
+            ok = true;
+            for (size_t i = 0; i + 1 < n; i++) {
+                const u128 x = self_test_u128(rng);
+                c[i] = x;
+                v[i] = x;
+                ok &= c[i] == x && x == c[i] && !(c[i] != x) && c[i] <= x && x >= c[i];
+                ok &= (c[i] < c[i + 1]) == (v[i] < v[i + 1]) && (c[i] > v[i + 1]) == (v[i] > v[i + 1]) &&
+                    (v[i] < c[i + 1]) == (v[i] < v[i + 1]);
+                if (i % 3 == 0) {
+                    c[i] = c[i + 1];
+                    v[i] = v[i + 1];
+                }
+                if (i % 3 == 1) {
+                    swap(c[i], c[i + 1]);
+                    std::swap(v[i], v[i + 1]);
+                }
+                *(c.begin() + (std::ptrdiff_t)i) = v[i] + ONE;
+                v[i] += ONE;
+            }
+            if (!ok || !same(c, v))
+                failures += self_test_fail("u128_column reference", what);
+
+            // standard algorithms through the proxy iterators
+            std::sort(c.begin(), c.end());
+            std::sort(v.begin(), v.end());
+            if (!same(c, v))
+                failures += self_test_fail("u128_column std::sort", what);
+            for (int k = 0; k < 8; k++) {
+                const u128 key = n && k % 2 ? v[rng() % n] : self_test_u128(rng);
+                if (std::lower_bound(c.cbegin(), c.cend(), key) - c.cbegin() != std::lower_bound(v.begin(), v.end(), key) - v.begin())
+                    failures += self_test_fail("u128_column std::lower_bound", what, key.to_string_hex());
+            }
+
+            // column kernels
+            std::vector<size_t> h(n);
+            hash_n(c, h.data(), seed);
+            ok = true;
+            for (size_t i = 0; i < n; i++)
+                ok &= h[i] == (size_t)hash128(v[i], seed);
+            hash_n(c, h.data());
+            for (size_t i = 0; i < n; i++)
+                ok &= h[i] == std::hash<u128>{}(v[i]);
+            if (!ok)
+                failures += self_test_fail("u128_column hash_n", what);
+            u128_column other(n), sum(1), diff;
+            std::vector<u128> w(n);
+            for (size_t i = 0; i < n; i++)
+                other.set(i, w[i] = rng() % 4 ? self_test_u128(rng) : v[i] + (rng() % 3) - ONE);
+            add_n(c, other, sum);
+            xor_n(c, other, diff);
+            std::vector<char> lt(n + 1, 2);
+            cmp_lt_n(c, other, reinterpret_cast<bool*>(lt.data()));
+            ok = sum.size() == n && diff.size() == n && lt[n] == 2;
+            for (size_t i = 0; ok && i < n; i++)
+                ok &= sum[i] == v[i] + w[i] && diff[i] == (v[i] ^ w[i]) && (lt[i] != 0) == (v[i] < w[i]);
+            if (!ok)
+                failures += self_test_fail("u128_column add_n/xor_n/cmp_lt_n", what);
+        }
+
+        // Range scans. The elements' hi words lie on or next to the bounds' hi
+        // words, so that both the on-bound path (d == 0 or d == span) and the hi
+        // word decision on either side of it are taken, including d wrapping
+        // below first.hi.
+        const size_t n = 300;
+        std::vector<size_t> selected(n), expect;
+        for (int round = 0; round < 400; round++) {
+            const u64 base = round % 4 == 0 ? 0 : round % 4 == 1 ? UINT64_MAX - 3 : self_test_u64(rng);
+            u128 first(self_test_u64(rng), base), last(self_test_u64(rng), base + rng() % 4);
+            if (round % 7 == 0)
+                std::swap(first, last);         // empty or inverted ranges too
+            if (round == 1) {
+                first = ZERO;
+                last = MAX;
+            }
+            u128_column c;
+            for (size_t i = 0; i < n; i++) {
+                const u64 hi = (rng() % 2 ? first.hi : last.hi) + (rng() % 3) - 1;
+                const u64 lo = rng() % 2 ? self_test_u64(rng) : rng() % 2 ? first.lo + (rng() % 3) - 1 : last.lo + (rng() % 3) - 1;
+                c.push_back(u128(lo, hi));
+            }
+            expect.clear();
+            for (size_t i = 0; i < n; i++)
+                if (c[i] >= first && c[i] < last)
+                    expect.push_back(i);
+            const size_t count = count_in_range(c, first, last);
+            const size_t k = select_in_range(c, first, last, selected.data());
+            if (count != expect.size() || k != expect.size() || !std::equal(expect.begin(), expect.end(), selected.begin()))
+                failures += self_test_fail("count_in_range/select_in_range", first.to_string_hex(), last.to_string_hex());
+        }
+        return failures;
+    }
+
+#endif
+
+} // namespace u128
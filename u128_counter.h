@@ -0,0 +1,214 @@
+#pragma once
+// file u128_counter.h
+
+// class u128_counter
+//      A 128 bit counter and ID generator for many threads, spread over
+//      cache line sized shards so that threads do not fight over one line.
+//
+//      add(n) adds to the calling thread's shard, and aggregate() sums the
+//      shards for the global total.
+//
+//      reserve(n) hands out n consecutive IDs with one atomic add on the
+//      shared ID line. A u128_counter::local, one per thread, takes blocks
+//      of IDs that way and then issues them one at a time with no atomics:
+//      IDs are unique, and increasing within each thread, but not across
+//      threads.
+//
+// int test_counter(u64 seed = 1)
+//      With U128_SELF_TEST, checks add, aggregate, reserve and local in one
+//      thread, then totals and ID uniqueness across several; returns the
+//      number of failures.
+
+#include "u128.h"
+#include "u128_atomic.h"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <thread>
+
+#if U128_SELF_TEST
+#include <algorithm>
+#include <vector>
+#endif
+
+
+namespace u128 {
+
+    class u128_counter {
+    public:
+        // Twice the usual line size: Intel and AMD cores also prefetch the
+        // adjacent line, which makes neighbouring lines share as well.
+        static constexpr size_t line_size = 128;
+
+        // One shard per hardware thread, by default, so that threads rarely
+        // meet in one.
+        explicit u128_counter(size_t shards = std::thread::hardware_concurrency(), const u128& first_id = u128())
+            : shards_(shards ? shards : 1), slots_(new slot[shards_]) {
+            next_id_.value = first_id;
+        }
+
+        u128_counter(const u128_counter&) = delete;
+        u128_counter& operator=(const u128_counter&) = delete;
+
+        size_t shards() const noexcept { return shards_; }
+
+        // Adds n to the calling thread's shard.
+        void add(const u128& n = ONE) noexcept {
+            slots_[thread_index() % shards_].value.fetch_add(n);
+        }
+
+        // The sum of all shards (mod 2¹²⁸). Exact when no add runs at the same
+        // time; otherwise it includes some of the concurrent adds.
+        u128 aggregate() const noexcept {
+            u128 sum;
+            for (size_t i = 0; i < shards_; i++)
+                sum += slots_[i].value.load();
+            return sum;
+        }
+
+        // Reserves n consecutive IDs and returns the first. IDs wrap after 2¹²⁸.
+        u128 reserve(u64 n) noexcept {
+            return next_id_.value.fetch_add(u128(n));
+        }
+
+        // The first ID not yet reserved.
+        u128 next_unreserved() const noexcept { return next_id_.value.load(); }
+
+        // Issues IDs from blocks of counter.reserve(block). Not thread safe:
+        // each thread keeps its own. IDs left in the last block when it is
+        // destroyed are lost, so larger blocks trade gaps for fewer atomics.
+        class local {
+        public:
+            explicit local(u128_counter& counter, u64 block = 1024) noexcept
+                : counter_(&counter), block_(block ? block : 1) {}
+
+            u128 next() noexcept {
+                if (next_ == end_) {
+                    next_ = counter_->reserve(block_);
+                    end_ = next_ + block_;
+                }
+                const u128 id = next_;
+                next_ += ONE;
+                return id;
+            }
+
+        private:
+            u128_counter* counter_;
+            u64 block_;
+            u128 next_, end_;   // the rest of the current block
+        };
+
+    private:
+        struct alignas(line_size) slot {
+            u128_atomic value;
+        };
+
+        // A small number per thread, handed out in the order threads first
+        // ask, so that up to shards() threads get a shard each.
+        static size_t thread_index() noexcept {
+            static std::atomic<size_t> next_index{ 0 };
+            thread_local const size_t index = next_index.fetch_add(1, std::memory_order_relaxed);
+            return index;
+        }
+
+        slot next_id_;
+        size_t shards_;
+        std::unique_ptr<slot[]> slots_;
+    };
+
+
+#if U128_SELF_TEST
+
+    // -----------------------------------------------------------------------------
+    // Self test
+    // -----------------------------------------------------------------------------
+
+    // In one thread: aggregate() against a plain sum of the adds, reserve()
+    // handing out consecutive blocks and wrapping after 2¹²⁸, and local issuing
+    // consecutive IDs across block boundaries. Then four threads on two shards,
+    // so that shards are shared, each adding a value that carries into hi and
+    // taking IDs from its own local: the total must be exact and the IDs
+    // unique, increasing within each thread, and all from the reserved range.
+    inline int test_counter(u64 seed = 1) {
+        std::mt19937_64 rng(seed);
+        int failures = 0;
+
+        u128_counter counter(3, u128(0, 42));
+        u128 sum;
+        for (int i = 0; i < 1000; i++) {
+            const u128 v = self_test_u128(rng);
+            counter.add(v);
+            counter.add();
+            sum += v + ONE;
+        }
+        if (counter.shards() != 3 || counter.aggregate() != sum || u128_counter(0).shards() != 1)
+            failures += self_test_fail("u128_counter add", sum.to_string(), counter.aggregate().to_string());
+
+        u128 expect(0, 42);
+        for (int i = 0; i < 100; i++) {
+            const u64 n = rng() % 1000;
+            if (counter.reserve(n) != expect)
+                failures += self_test_fail("u128_counter reserve", expect.to_string(), std::to_string(n));
+            expect += n;
+        }
+        if (counter.next_unreserved() != expect)
+            failures += self_test_fail("u128_counter next_unreserved", expect.to_string());
+
+        u128_counter wrapping(1, MAX - ONE);
+        if (wrapping.reserve(3) != MAX - ONE || wrapping.next_unreserved() != ONE)
+            failures += self_test_fail("u128_counter reserve wrap", wrapping.next_unreserved().to_string());
+
+        for (u64 block : { 0, 1, 7, 1024 }) {
+            u128_counter ids(1, u128(0, 7));
+            u128_counter::local local(ids, block);
+            bool ok = true;
+            for (u64 i = 0; i < 3000; i++)
+                ok &= local.next() == u128(i, 7);
+            // blocks of max(block, 1), of which 3000 IDs used up a whole number
+            const u64 b = block ? block : 1;
+            if (!ok || ids.next_unreserved() != u128((3000 + b - 1) / b * b, 7))
+                failures += self_test_fail("u128_counter::local", std::to_string(block));
+        }
+
+        // the threads wait for each other so that they actually overlap
+        constexpr int threads = 4, adds = 100000;
+        const u128 step(UINT64_MAX, 1);
+        const u128 first(0, 0x5eed);
+        u128_counter shared(2, first);
+        std::atomic<int> ready(0);
+        std::vector<std::vector<u128>> issued(threads);
+        std::vector<std::thread> pool;
+        for (int t = 0; t < threads; t++) {
+            pool.emplace_back([&shared, &step, &ready, &ids = issued[t], t]() {
+                ready.fetch_add(1);
+                while (ready.load() < threads) {
+                }
+                u128_counter::local local(shared, 1 + (u64)t * 10);
+                for (int i = 0; i < adds; i++) {
+                    shared.add(step);
+                    ids.push_back(local.next());
+                }
+            });
+        }
+        for (std::thread& t : pool)
+            t.join();
+        if (shared.aggregate() != step * u128(u64(threads) * adds))
+            failures += self_test_fail("u128_counter threads", shared.aggregate().to_string());
+
+        std::vector<u128> all;
+        bool increasing = true;
+        for (const std::vector<u128>& ids : issued) {
+            increasing &= std::is_sorted(ids.begin(), ids.end()) && ids.size() == (size_t)adds;
+            all.insert(all.end(), ids.begin(), ids.end());
+        }
+        std::sort(all.begin(), all.end());
+        if (!increasing || std::adjacent_find(all.begin(), all.end()) != all.end() ||
+            all.front() < first || !(all.back() < shared.next_unreserved()))
+            failures += self_test_fail("u128_counter::local threads", std::to_string(all.size()));
+        return failures;
+    }
+
+#endif
+
+} // namespace u128
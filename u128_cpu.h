@@ -0,0 +1,142 @@
+#pragma once
+// file u128_cpu.h
+
+// struct cpu_features
+//      The instruction set extensions the running CPU (and OS) supports, as far
+//      as the u128 kernels care.
+//
+// const cpu_features& cpu()
+//      Detected once, on first use.
+//
+// U128_TARGET(isa)
+//      Marks a function as compiled for isa (e.g. "avx2") so that it can use
+//      those intrinsics in a binary built for a baseline target. Such a function
+//      must only be called after checking cpu().
+//
+// unsigned thread_count(unsigned requested, size_t n, size_t min_each)
+// void parallel_for(unsigned threads, const F& f)
+//      How many threads to split n items over, and running f(t) on each, for
+//      the kernels that take a thread count.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>   // for __cpuid, __cpuidex, _xgetbv
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>    // for __get_cpuid, __get_cpuid_count
+#endif
+
+#if defined(__GNUC__) && !defined(_MSC_VER)
+#define U128_TARGET(isa) __attribute__((target(isa)))
+#else
+#define U128_TARGET(isa)  // MSVC allows any intrinsic in any function
+#endif
+
+// U128_X86 is 1 when compiling for x86 or x86-64 with a compiler whose
+// intrinsics headers we know how to use.
+#if (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))) || \
+    (defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)))
+#define U128_X86 1
+#else
+#define U128_X86 0
+#endif
+
+// U128_NEON is 1 on AArch64, where Advanced SIMD is always present.
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define U128_NEON 1
+#else
+#define U128_NEON 0
+#endif
+
+
+namespace u128 {
+
+    // Instruction set extensions relevant to the u128 kernels. Each flag is only
+    // set if the OS also saves the corresponding register state.
+    struct cpu_features {
+        bool bmi2 = false;          // mulx
+        bool adx = false;           // adcx, adox
+        bool avx2 = false;
+        bool avx512f = false;
+        bool avx512ifma = false;    // vpmadd52luq, vpmadd52huq
+        bool neon = false;
+    };
+
+    // Queries cpuid (x86) or the target (AArch64). Prefer cpu(), which caches this.
+    inline cpu_features detect_cpu_features() noexcept {
+        cpu_features f;
+
+#if U128_X86
+        unsigned r1[4] = {}, r7[4] = {};    // eax, ebx, ecx, edx of leaves 1 and 7
+        unsigned long long xcr0 = 0;
+#if defined(_MSC_VER)
+        int r[4];
+        __cpuid(r, 0);
+        const int max_leaf = r[0];
+        __cpuid(r, 1);
+        for (int i = 0; i < 4; i++) r1[i] = (unsigned)r[i];
+        if (max_leaf >= 7) {
+            __cpuidex(r, 7, 0);
+            for (int i = 0; i < 4; i++) r7[i] = (unsigned)r[i];
+        }
+        if (r1[2] & (1u << 27))             // OSXSAVE
+            xcr0 = _xgetbv(0);
+#else
+        __get_cpuid(1, &r1[0], &r1[1], &r1[2], &r1[3]);
+        __get_cpuid_count(7, 0, &r7[0], &r7[1], &r7[2], &r7[3]);
+        if (r1[2] & (1u << 27)) {           // OSXSAVE
+            unsigned lo, hi;
+            __asm__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+            xcr0 = ((unsigned long long)hi << 32) | lo;
+        }
+#endif
+        const bool os_avx = (xcr0 & 0x06) == 0x06;         // XMM and YMM state
+        const bool os_avx512 = (xcr0 & 0xE6) == 0xE6;      // plus opmask and ZMM state
+        const unsigned ebx = r7[1];
+
+        f.bmi2 = (ebx >> 8) & 1;
+        f.adx = (ebx >> 19) & 1;
+        f.avx2 = os_avx && ((ebx >> 5) & 1);
+        f.avx512f = os_avx512 && ((ebx >> 16) & 1);
+        f.avx512ifma = f.avx512f && ((ebx >> 21) & 1);
+#endif
+
+#if U128_NEON
+        f.neon = true;
+#endif
+        return f;
+    }
+
+    // The features of the running CPU, detected on first use.
+    inline const cpu_features& cpu() noexcept {
+        static const cpu_features features = detect_cpu_features();
+        return features;
+    }
+
+    // The number of threads to split n items over: requested, or one per
+    // hardware thread if it is 0, but few enough that each gets min_each items
+    // (starting threads costs tens of microseconds).
+    inline unsigned thread_count(unsigned requested, size_t n, size_t min_each) noexcept {
+        if (requested == 0)
+            requested = std::max(1u, std::thread::hardware_concurrency());
+        return (unsigned)std::min<size_t>(requested, std::max<size_t>(1, n / min_each));
+    }
+
+    // Runs f(0) … f(threads - 1), f(0) on the calling thread and the others on
+    // threads of their own, and returns when all have finished.
+    template<typename F>
+    void parallel_for(unsigned threads, const F& f) {
+        std::vector<std::thread> pool;
+        pool.reserve(threads ? threads - 1 : 0);
+        for (unsigned t = 1; t < threads; t++)
+            pool.emplace_back(f, t);
+        f(0u);
+        for (std::thread& th : pool)
+            th.join();
+    }
+
+} // namespace u128
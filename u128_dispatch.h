@@ -0,0 +1,305 @@
+#pragma once
+// file u128_dispatch.h
+
+// Run time dispatch of the multi-limb kernels, for binaries built for a
+// baseline x86-64 that run on newer CPUs too.
+//
+// void mul128_n(const u128* a, const u128* b, u256* out, size_t n)
+//      out[i] = mul128(a[i], b[i])
+//
+// void mont_mul_n(const montgomery128& m, const u128* a, const u128* b, u128* out, size_t n)
+//      out[i] = m.mul(a[i], b[i])
+//
+// void mont_pow_n(const montgomery128& m, const u128* base, const u128& e, u128* out, size_t n)
+//      out[i] = m.pow(base[i], e), e.g. for many Fermat or Miller-Rabin bases
+//
+// const char* wide_isa()
+//      Name of the kernel set in use: "bmi2+adx", "bmi2" or "generic".
+//
+// dispatch_info dispatch(), std::string describe_dispatch()
+//      Every choice the headers made for this build and CPU: the mul64 path, the
+//      multi-limb and batch kernel sets and the detected features; as a struct
+//      or as one line for logs and telemetry.
+//
+// The kernels are chosen once, from cpu(), and called through a table, which
+// costs an indirect call per array: use the scalar functions in u128.h for
+// single products.
+//
+// int test_wide_kernels(u64 seed = 1)
+//      With U128_SELF_TEST, checks every kernel set this CPU can run against
+//      the scalar functions; returns the number of failures.
+
+#include "u128.h"
+#include "u128_cpu.h"
+#include "u128_simd.h"
+
+#include <cstddef>
+#include <string>
+
+
+namespace u128 {
+
+    // -----------------------------------------------------------------------------
+    // Kernels
+    // -----------------------------------------------------------------------------
+
+    // The kernels in terms of the u128.h arithmetic. Compiled once for the
+    // baseline target, and once more with BMI2 enabled (below), where the same
+    // source compiles its 64 × 64 multiplies to mulx, which leaves the flags alone
+    // and so interleaves with the add with carry chains.
+    struct wide_generic {
+        static void mul128_n(const u128* a, const u128* b, u256* out, size_t n) noexcept {
+            for (size_t i = 0; i < n; i++)
+                out[i] = mul128(a[i], b[i]);
+        }
+        static void mont_mul_n(const montgomery128& m, const u128* a, const u128* b, u128* out, size_t n) noexcept {
+            for (size_t i = 0; i < n; i++)
+                out[i] = m.mul(a[i], b[i]);
+        }
+        static void mont_pow_n(const montgomery128& m, const u128* base, const u128& e, u128* out, size_t n) noexcept {
+            for (size_t i = 0; i < n; i++)
+                out[i] = m.pow(base[i], e);
+        }
+    };
+
+
+#if U128_X86 && !U128_PORTABLE
+
+    struct wide_bmi2 {
+        U128_TARGET("bmi2")
+        static void mul128_n(const u128* a, const u128* b, u256* out, size_t n) noexcept {
+            for (size_t i = 0; i < n; i++)
+                out[i] = mul128(a[i], b[i]);
+        }
+        U128_TARGET("bmi2")
+        static void mont_mul_n(const montgomery128& m, const u128* a, const u128* b, u128* out, size_t n) noexcept {
+            for (size_t i = 0; i < n; i++)
+                out[i] = m.mul(a[i], b[i]);
+        }
+        U128_TARGET("bmi2")
+        static void mont_pow_n(const montgomery128& m, const u128* base, const u128& e, u128* out, size_t n) noexcept {
+            for (size_t i = 0; i < n; i++)
+                out[i] = m.pow(base[i], e);
+        }
+    };
+
+#endif
+
+
+#if defined(__GNUC__) && defined(__x86_64__) && !U128_PORTABLE
+
+    // mulx for the four partial products, and adcx / adox to add the two cross
+    // terms in as two carry chains (on CF and OF) at once. Compilers never emit
+    // adcx / adox themselves, even from _addcarryx_u64, hence the asm; about a
+    // third faster than mul128 in a loop.
+    struct wide_adx {
+        U128_TARGET("bmi2,adx")
+        static u256 mul128(const u128& a, const u128& b) noexcept {
+            u256 r;
+            u64 r1, t, r2, u1, u2, t2, r3, zero = 0, d = b.lo;
+            __asm__(
+                "mulx %[a0], %[r0], %[r1]\n\t"      // r1:r0 = a0·b0
+                "mulx %[a1], %[t], %[r2]\n\t"       // r2:t  = a1·b0
+                "movq %[b1], %%rdx\n\t"
+                "mulx %[a0], %[u1], %[u2]\n\t"      // u2:u1 = a0·b1
+                "mulx %[a1], %[t2], %[r3]\n\t"      // r3:t2 = a1·b1
+                "xorl %k[zero], %k[zero]\n\t"       // clears CF and OF
+                "adcx %[t], %[r1]\n\t"
+                "adox %[u1], %[r1]\n\t"
+                "adcx %[t2], %[r2]\n\t"
+                "adox %[u2], %[r2]\n\t"
+                "adcx %[zero], %[r3]\n\t"
+                "adox %[zero], %[r3]"
+                : [r0] "=&r"(r.limb[0]), [r1] "=&r"(r1), [t] "=&r"(t), [r2] "=&r"(r2),
+                  [u1] "=&r"(u1), [u2] "=&r"(u2), [t2] "=&r"(t2), [r3] "=&r"(r3),
+                  [zero] "+&r"(zero), "+&d"(d)
+                : [a0] "r"(a.lo), [a1] "r"(a.hi), [b1] "r"(b.hi)
+                : "cc");
+            r.limb[1] = r1;
+            r.limb[2] = r2;
+            r.limb[3] = r3;
+            return r;
+        }
+
+        // montgomery128::mul, with both of its products from the mul128 above.
+        U128_TARGET("bmi2,adx")
+        static u128 mont_mul(const montgomery128& m, const u128& a, const u128& b) noexcept {
+            const u256 t = mul128(a, b);
+            return m.reduce(t, mul128(t.lo() * m.ninv, m.n));
+        }
+
+        U128_TARGET("bmi2,adx")
+        static void mul128_n(const u128* a, const u128* b, u256* out, size_t n) noexcept {
+            for (size_t i = 0; i < n; i++)
+                out[i] = mul128(a[i], b[i]);
+        }
+        U128_TARGET("bmi2,adx")
+        static void mont_mul_n(const montgomery128& m, const u128* a, const u128* b, u128* out, size_t n) noexcept {
+            for (size_t i = 0; i < n; i++)
+                out[i] = mont_mul(m, a[i], b[i]);
+        }
+        U128_TARGET("bmi2,adx")
+        static void mont_pow_n(const montgomery128& m, const u128* base, const u128& e, u128* out, size_t n) noexcept {
+            // as montgomery128::pow, squaring with the mul128 above
+            const int top = bit_width(e) - 1;
+            for (size_t i = 0; i < n; i++) {
+                u128 result = m.r1;
+                for (int j = top; j >= 0; j--) {
+                    result = mont_mul(m, result, result);
+                    if (((e >> (unsigned)j).lo & 1) != 0)
+                        result = mont_mul(m, result, base[i]);
+                }
+                out[i] = result;
+            }
+        }
+    };
+
+#endif
+
+
+    // -----------------------------------------------------------------------------
+    // Dispatch
+    // -----------------------------------------------------------------------------
+
+    struct wide_kernels {
+        void (*mul128_n)(const u128*, const u128*, u256*, size_t) noexcept;
+        void (*mont_mul_n)(const montgomery128&, const u128*, const u128*, u128*, size_t) noexcept;
+        void (*mont_pow_n)(const montgomery128&, const u128*, const u128&, u128*, size_t) noexcept;
+        const char* isa;
+    };
+
+    inline wide_kernels select_wide_kernels(const cpu_features& f) noexcept {
+#if defined(__GNUC__) && defined(__x86_64__) && !U128_PORTABLE
+        if (f.bmi2 && f.adx)
+            return { wide_adx::mul128_n, wide_adx::mont_mul_n, wide_adx::mont_pow_n, "bmi2+adx" };
+#endif
+#if U128_X86 && !U128_PORTABLE
+        if (f.bmi2)
+            return { wide_bmi2::mul128_n, wide_bmi2::mont_mul_n, wide_bmi2::mont_pow_n, "bmi2" };
+#endif
+        (void)f;
+        return { wide_generic::mul128_n, wide_generic::mont_mul_n, wide_generic::mont_pow_n, "generic" };
+    }
+
+    // The kernels for the running CPU, chosen on first use.
+    inline const wide_kernels& wide() noexcept {
+        static const wide_kernels kernels = select_wide_kernels(cpu());
+        return kernels;
+    }
+
+    inline void mul128_n(const u128* a, const u128* b, u256* out, size_t n) noexcept {
+        wide().mul128_n(a, b, out, n);
+    }
+    inline void mont_mul_n(const montgomery128& m, const u128* a, const u128* b, u128* out, size_t n) noexcept {
+        wide().mont_mul_n(m, a, b, out, n);
+    }
+    inline void mont_pow_n(const montgomery128& m, const u128* base, const u128& e, u128* out, size_t n) noexcept {
+        wide().mont_pow_n(m, base, e, out, n);
+    }
+    inline const char* wide_isa() noexcept {
+        return wide().isa;
+    }
+
+
+    // -----------------------------------------------------------------------------
+    // Introspection
+    // -----------------------------------------------------------------------------
+
+    struct dispatch_info {
+        const char* mul64;      // mul64_path(), fixed at build time
+        const char* wide;       // wide_isa()
+        const char* batch;      // batch_isa()
+        cpu_features cpu;       // cpu()
+    };
+
+    inline dispatch_info dispatch() noexcept {
+        return { mul64_path(), wide_isa(), batch_isa(), cpu() };
+    }
+
+    // One line, e.g. "mul64=__int128 wide=bmi2+adx batch=avx2 cpu=bmi2,adx,avx2".
+    inline std::string describe_dispatch() {
+        const dispatch_info d = dispatch();
+        std::string s = std::string("mul64=") + d.mul64 + " wide=" + d.wide + " batch=" + d.batch + " cpu=";
+        const struct { bool on; const char* name; } features[] = {
+            { d.cpu.bmi2, "bmi2" }, { d.cpu.adx, "adx" }, { d.cpu.avx2, "avx2" },
+            { d.cpu.avx512f, "avx512f" }, { d.cpu.avx512ifma, "avx512ifma" }, { d.cpu.neon, "neon" },
+        };
+        const size_t empty = s.size();
+        for (const auto& f : features) {
+            if (f.on) {
+                if (s.size() != empty)
+                    s += ',';
+                s += f.name;
+            }
+        }
+        if (s.size() == empty)
+            s += "none";
+        return s;
+    }
+
+
+#if U128_SELF_TEST
+
+    // -----------------------------------------------------------------------------
+    // Self test
+    // -----------------------------------------------------------------------------
+
+    // Every multi-limb kernel set this CPU can run (for cpu(), without ADX and
+    // without BMI2) against the u128.h functions, which wide_generic calls,
+    // including the REDC carry case and exponents of 0 and MAX.
+    inline int test_wide_kernels(u64 seed = 1) {
+        std::mt19937_64 rng(seed);
+        int failures = 0;
+
+        cpu_features f = cpu();
+        wide_kernels sets[3];
+        sets[0] = select_wide_kernels(f);
+        f.adx = false;
+        sets[1] = select_wide_kernels(f);
+        f.bmi2 = false;
+        sets[2] = select_wide_kernels(f);
+
+        constexpr size_t n = 67;
+        u128 a[n], b[n], x[n], y[n], out[n];
+        u256 wide_out[n];
+        for (size_t i = 0; i < n; i++) {
+            a[i] = self_test_u128(rng);
+            b[i] = self_test_u128(rng);
+        }
+        for (const wide_kernels& k : sets) {
+            k.mul128_n(a, b, wide_out, n);
+            for (size_t i = 0; i < n; i++) {
+                if (!(wide_out[i] == mul128(a[i], b[i])))
+                    failures += self_test_fail("mul128_n", k.isa, a[i].to_string() + " " + b[i].to_string());
+            }
+            for (int j = 0; j < 20; j++) {
+                const u128 modulus = j == 0 ? MAX : j == 1 ? u128(3) : self_test_u128(rng) | u128(3);
+                const montgomery128 m(modulus);
+                for (size_t i = 0; i < n; i++) {
+                    x[i] = m.to_mont(a[i]);
+                    y[i] = m.to_mont(b[i]);
+                }
+                if (j == 0) {
+                    // 7 and its inverse modulo 2¹²⁸ - 1, see test_montgomery
+                    x[0] = u128(7);
+                    y[0] = u128(0x9249249249249249ULL, 0x4924924924924924ULL);
+                }
+                k.mont_mul_n(m, x, y, out, n);
+                for (size_t i = 0; i < n; i++) {
+                    if (out[i] != m.mul(x[i], y[i]))
+                        failures += self_test_fail("mont_mul_n", k.isa, x[i].to_string() + " " + y[i].to_string());
+                }
+                const u128 e = j % 4 == 0 ? ZERO : j % 4 == 1 ? MAX : self_test_u128(rng);
+                k.mont_pow_n(m, x, e, out, 4);
+                for (size_t i = 0; i < 4; i++) {
+                    if (out[i] != m.pow(x[i], e))
+                        failures += self_test_fail("mont_pow_n", k.isa, x[i].to_string() + " " + e.to_string());
+                }
+            }
+        }
+        return failures;
+    }
+
+#endif
+
+} // namespace u128
@@ -0,0 +1,775 @@
+#pragma once
+// file u128_simd.h
+
+// Batch kernels over arrays of u128, with run time dispatch to the widest
+// vector unit the CPU has (AVX-512, AVX2 or NEON), falling back to scalar code.
+//
+// void add_n(const u128* a, const u128* b, u128* out, size_t n)
+//      out[i] = a[i] + b[i] (mod 2¹²⁸)
+//
+// void xor_n(const u128* a, const u128* b, u128* out, size_t n)
+//      out[i] = a[i] ^ b[i]
+//
+// void cmp_lt_n(const u128* a, const u128* b, bool* out, size_t n)
+//      out[i] = a[i] < b[i]
+//
+// void mul64_n(const u64* a, const u64* b, u128* out, size_t n)
+//      out[i] = mul64(a[i], b[i])
+//
+// void hash_n(const u128* keys, size_t* out, size_t n, u64 seed = 0)
+//      out[i] = hash128(keys[i], seed), so with seed 0, std::hash<u128>{}(keys[i])
+//
+// add_n_soa, cmp_lt_n_soa
+//      The same for structure-of-arrays data (separate lo and hi limb arrays),
+//      see u128_column.h.
+//
+// u128 sum_u64_to_u128(const u64* a, size_t n, unsigned threads = 1)
+//      a[0] + … + a[n - 1], exact for n < 2⁶⁴
+//
+// u128 dot_u64(const u64* a, const u64* b, size_t n, unsigned threads = 1)
+//      mul64(a[0], b[0]) + … + mul64(a[n - 1], b[n - 1]) (mod 2¹²⁸)
+//
+// void inclusive_scan(const u128* in, u128* out, size_t n, unsigned threads = 1)
+//      out[i] = in[0] + … + in[i] (mod 2¹²⁸)
+//
+// The functions with a threads argument split large inputs over that many
+// threads, or one per hardware thread for 0 (see thread_count in u128_cpu.h).
+//
+// const char* batch_isa()
+//      Name of the kernel set in use: "avx512", "avx2", "neon" or "scalar".
+//
+// Arrays may overlap only if they are identical (out == a is fine). No
+// alignment is required.
+//
+// int test_batch_kernels(u64 seed = 1)
+//      With U128_SELF_TEST, checks every kernel set this CPU can run against
+//      the plain operators; returns the number of failures.
+
+#include "u128.h"
+#include "u128_cpu.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#if U128_X86
+#include <immintrin.h>
+#endif
+#if U128_NEON
+#include <arm_neon.h>
+#endif
+
+
+namespace u128 {
+
+    // -----------------------------------------------------------------------------
+    // Scalar kernels, also used for the tails of the vector ones
+    // -----------------------------------------------------------------------------
+
+    struct batch_scalar {
+        static void add_n(const u128* a, const u128* b, u128* out, size_t n) noexcept {
+            for (size_t i = 0; i < n; i++)
+                out[i] = a[i] + b[i];
+        }
+        static void xor_n(const u128* a, const u128* b, u128* out, size_t n) noexcept {
+            for (size_t i = 0; i < n; i++)
+                out[i] = a[i] ^ b[i];
+        }
+        static void cmp_lt_n(const u128* a, const u128* b, bool* out, size_t n) noexcept {
+            // Branch free: the result of the high word compare, unless the high
+            // words are equal.
+            for (size_t i = 0; i < n; i++)
+                out[i] = (a[i].hi < b[i].hi) | ((a[i].hi == b[i].hi) & (a[i].lo < b[i].lo));
+        }
+        static void mul64_n(const u64* a, const u64* b, u128* out, size_t n) noexcept {
+            for (size_t i = 0; i < n; i++)
+                out[i] = mul64(a[i], b[i]);
+        }
+        static void hash_n(const u128* keys, size_t* out, size_t n, u64 seed) noexcept {
+            // Keys are independent, so the multiplies of neighbouring keys
+            // overlap in the pipeline; the seed is mixed once, not per key.
+            const u64 mixed = hash_mix_seed(seed);
+            for (size_t i = 0; i < n; i++)
+                out[i] = static_cast<size_t>(hash128_mixed(keys[i], mixed));
+        }
+        static void add_n_soa(const u64* a_lo, const u64* a_hi, const u64* b_lo, const u64* b_hi,
+            u64* out_lo, u64* out_hi, size_t n) noexcept {
+            for (size_t i = 0; i < n; i++) {
+                const u64 lo = a_lo[i] + b_lo[i];
+                out_hi[i] = a_hi[i] + b_hi[i] + (lo < a_lo[i]);
+                out_lo[i] = lo;
+            }
+        }
+        static void cmp_lt_n_soa(const u64* a_lo, const u64* a_hi, const u64* b_lo, const u64* b_hi,
+            bool* out, size_t n) noexcept {
+            for (size_t i = 0; i < n; i++)
+                out[i] = (a_hi[i] < b_hi[i]) | ((a_hi[i] == b_hi[i]) & (a_lo[i] < b_lo[i]));
+        }
+        static u128 sum_u64(const u64* a, size_t n) noexcept {
+            // Four independent sums, each a u64 and a count of its carries, in
+            // place of one u128 whose add-with-carry chain allows one element
+            // per cycle at best.
+            u64 s0 = 0, s1 = 0, s2 = 0, s3 = 0, c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                s0 += a[i];
+                c0 += s0 < a[i];
+                s1 += a[i + 1];
+                c1 += s1 < a[i + 1];
+                s2 += a[i + 2];
+                c2 += s2 < a[i + 2];
+                s3 += a[i + 3];
+                c3 += s3 < a[i + 3];
+            }
+            u128 sum(s0, c0 + c1 + c2 + c3);
+            sum += s1;
+            sum += s2;
+            sum += s3;
+            for (; i < n; i++)
+                sum += a[i];
+            return sum;
+        }
+    };
+
+
+#if U128_X86
+
+    // -----------------------------------------------------------------------------
+    // AVX2: two u128 per 256 bit register, one per 128 bit lane as [lo, hi]
+    // -----------------------------------------------------------------------------
+
+    struct batch_avx2 {
+        // Unsigned 64 bit a < b, as all ones / all zeros per lane. AVX2 only has a
+        // signed compare, so flip the sign bits first.
+        U128_TARGET("avx2")
+        static __m256i lt_epu64(__m256i a, __m256i b) noexcept {
+            const __m256i sign = _mm256_set1_epi64x((long long)0x8000000000000000ULL);
+            return _mm256_cmpgt_epi64(_mm256_xor_si256(b, sign), _mm256_xor_si256(a, sign));
+        }
+
+        U128_TARGET("avx2")
+        static void add_n(const u128* a, const u128* b, u128* out, size_t n) noexcept {
+            size_t i = 0;
+            for (; i + 2 <= n; i += 2) {
+                const __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+                const __m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+                __m256i s = _mm256_add_epi64(x, y);
+
+                // A carry out of a lo word is all ones in that lane; the in-lane byte
+                // shift moves it onto the hi word of the same u128, where
+                // subtracting -1 adds the carry.
+                const __m256i carry = _mm256_slli_si256(lt_epu64(s, x), 8);
+                s = _mm256_sub_epi64(s, carry);
+                _mm256_storeu_si256((__m256i*)(out + i), s);
+            }
+            batch_scalar::add_n(a + i, b + i, out + i, n - i);
+        }
+
+        U128_TARGET("avx2")
+        static void xor_n(const u128* a, const u128* b, u128* out, size_t n) noexcept {
+            size_t i = 0;
+            for (; i + 2 <= n; i += 2) {
+                const __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+                const __m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+                _mm256_storeu_si256((__m256i*)(out + i), _mm256_xor_si256(x, y));
+            }
+            batch_scalar::xor_n(a + i, b + i, out + i, n - i);
+        }
+
+        U128_TARGET("avx2")
+        static void cmp_lt_n(const u128* a, const u128* b, bool* out, size_t n) noexcept {
+            size_t i = 0;
+            for (; i + 2 <= n; i += 2) {
+                const __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+                const __m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+                // one bit per 64 bit word: lo0, hi0, lo1, hi1
+                const unsigned lt = (unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(lt_epu64(x, y)));
+                const unsigned eq = (unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(x, y)));
+                // bit 2j: hi_lt | (hi_eq & lo_lt) for u128 j
+                const unsigned r = (lt >> 1) | ((eq >> 1) & lt);
+                out[i] = r & 1;
+                out[i + 1] = (r >> 2) & 1;
+            }
+            batch_scalar::cmp_lt_n(a + i, b + i, out + i, n - i);
+        }
+
+        // With the limbs in separate arrays nothing needs shuffling: four lanes
+        // of lo words, four of hi words, and a carry that stays in its lane.
+        U128_TARGET("avx2")
+        static void add_n_soa(const u64* a_lo, const u64* a_hi, const u64* b_lo, const u64* b_hi,
+            u64* out_lo, u64* out_hi, size_t n) noexcept {
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                const __m256i x = _mm256_loadu_si256((const __m256i*)(a_lo + i));
+                const __m256i lo = _mm256_add_epi64(x, _mm256_loadu_si256((const __m256i*)(b_lo + i)));
+                const __m256i hi = _mm256_add_epi64(_mm256_loadu_si256((const __m256i*)(a_hi + i)),
+                    _mm256_loadu_si256((const __m256i*)(b_hi + i)));
+                _mm256_storeu_si256((__m256i*)(out_lo + i), lo);
+                _mm256_storeu_si256((__m256i*)(out_hi + i), _mm256_sub_epi64(hi, lt_epu64(lo, x)));
+            }
+            batch_scalar::add_n_soa(a_lo + i, a_hi + i, b_lo + i, b_hi + i, out_lo + i, out_hi + i, n - i);
+        }
+
+        U128_TARGET("avx2")
+        static void cmp_lt_n_soa(const u64* a_lo, const u64* a_hi, const u64* b_lo, const u64* b_hi,
+            bool* out, size_t n) noexcept {
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                const __m256i xh = _mm256_loadu_si256((const __m256i*)(a_hi + i));
+                const __m256i yh = _mm256_loadu_si256((const __m256i*)(b_hi + i));
+                const __m256i lt_lo = lt_epu64(_mm256_loadu_si256((const __m256i*)(a_lo + i)),
+                    _mm256_loadu_si256((const __m256i*)(b_lo + i)));
+                const __m256i lt = _mm256_or_si256(lt_epu64(xh, yh), _mm256_and_si256(_mm256_cmpeq_epi64(xh, yh), lt_lo));
+                const unsigned r = (unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(lt));
+                for (size_t j = 0; j < 4; j++)
+                    out[i + j] = (r >> j) & 1;
+            }
+            batch_scalar::cmp_lt_n_soa(a_lo + i, a_hi + i, b_lo + i, b_hi + i, out + i, n - i);
+        }
+
+        // Eight lanes of u64 sums in two registers, with their carries counted
+        // in two more (a carry is all ones, so subtracting it counts one).
+        U128_TARGET("avx2")
+        static u128 sum_u64(const u64* a, size_t n) noexcept {
+            __m256i s0 = _mm256_setzero_si256(), s1 = s0, c0 = s0, c1 = s0;
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8) {
+                const __m256i x0 = _mm256_loadu_si256((const __m256i*)(a + i));
+                const __m256i x1 = _mm256_loadu_si256((const __m256i*)(a + i + 4));
+                s0 = _mm256_add_epi64(s0, x0);
+                s1 = _mm256_add_epi64(s1, x1);
+                c0 = _mm256_sub_epi64(c0, lt_epu64(s0, x0));
+                c1 = _mm256_sub_epi64(c1, lt_epu64(s1, x1));
+            }
+            alignas(32) u64 s[8], c[8];
+            _mm256_store_si256((__m256i*)s, s0);
+            _mm256_store_si256((__m256i*)(s + 4), s1);
+            _mm256_store_si256((__m256i*)c, c0);
+            _mm256_store_si256((__m256i*)(c + 4), c1);
+            u128 sum = batch_scalar::sum_u64(a + i, n - i);
+            for (size_t j = 0; j < 8; j++)
+                sum += u128(s[j], c[j]);
+            return sum;
+        }
+    };
+
+
+    // -----------------------------------------------------------------------------
+    // AVX-512: four u128 per 512 bit register, as [lo, hi] pairs
+    // -----------------------------------------------------------------------------
+
+    struct batch_avx512 {
+        U128_TARGET("avx512f")
+        static void add_n(const u128* a, const u128* b, u128* out, size_t n) noexcept {
+            const __m512i one = _mm512_set1_epi64(1);
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                const __m512i x = _mm512_loadu_si512((const void*)(a + i));
+                const __m512i y = _mm512_loadu_si512((const void*)(b + i));
+                const __m512i s = _mm512_add_epi64(x, y);
+
+                // carries out of the lo words (even bits) move to the hi words (odd bits)
+                const __mmask8 carry = (__mmask8)((_mm512_cmplt_epu64_mask(s, x) << 1) & 0xAA);
+                _mm512_storeu_si512((void*)(out + i), _mm512_mask_add_epi64(s, carry, s, one));
+            }
+            batch_scalar::add_n(a + i, b + i, out + i, n - i);
+        }
+
+        U128_TARGET("avx512f")
+        static void xor_n(const u128* a, const u128* b, u128* out, size_t n) noexcept {
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                const __m512i x = _mm512_loadu_si512((const void*)(a + i));
+                const __m512i y = _mm512_loadu_si512((const void*)(b + i));
+                _mm512_storeu_si512((void*)(out + i), _mm512_xor_si512(x, y));
+            }
+            batch_scalar::xor_n(a + i, b + i, out + i, n - i);
+        }
+
+        U128_TARGET("avx512f")
+        static void cmp_lt_n(const u128* a, const u128* b, bool* out, size_t n) noexcept {
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                const __m512i x = _mm512_loadu_si512((const void*)(a + i));
+                const __m512i y = _mm512_loadu_si512((const void*)(b + i));
+                const unsigned lt = _mm512_cmplt_epu64_mask(x, y);
+                const unsigned eq = _mm512_cmpeq_epu64_mask(x, y);
+                const unsigned r = (lt >> 1) | ((eq >> 1) & lt);    // bit 2j for u128 j
+                out[i] = r & 1;
+                out[i + 1] = (r >> 2) & 1;
+                out[i + 2] = (r >> 4) & 1;
+                out[i + 3] = (r >> 6) & 1;
+            }
+            batch_scalar::cmp_lt_n(a + i, b + i, out + i, n - i);
+        }
+
+        U128_TARGET("avx512f")
+        static void add_n_soa(const u64* a_lo, const u64* a_hi, const u64* b_lo, const u64* b_hi,
+            u64* out_lo, u64* out_hi, size_t n) noexcept {
+            const __m512i one = _mm512_set1_epi64(1);
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8) {
+                const __m512i x = _mm512_loadu_si512((const void*)(a_lo + i));
+                const __m512i lo = _mm512_add_epi64(x, _mm512_loadu_si512((const void*)(b_lo + i)));
+                const __m512i hi = _mm512_add_epi64(_mm512_loadu_si512((const void*)(a_hi + i)),
+                    _mm512_loadu_si512((const void*)(b_hi + i)));
+                _mm512_storeu_si512((void*)(out_lo + i), lo);
+                _mm512_storeu_si512((void*)(out_hi + i), _mm512_mask_add_epi64(hi, _mm512_cmplt_epu64_mask(lo, x), hi, one));
+            }
+            batch_scalar::add_n_soa(a_lo + i, a_hi + i, b_lo + i, b_hi + i, out_lo + i, out_hi + i, n - i);
+        }
+
+        U128_TARGET("avx512f")
+        static void cmp_lt_n_soa(const u64* a_lo, const u64* a_hi, const u64* b_lo, const u64* b_hi,
+            bool* out, size_t n) noexcept {
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8) {
+                const __m512i xh = _mm512_loadu_si512((const void*)(a_hi + i));
+                const __m512i yh = _mm512_loadu_si512((const void*)(b_hi + i));
+                const __mmask8 lt_lo = _mm512_cmplt_epu64_mask(_mm512_loadu_si512((const void*)(a_lo + i)),
+                    _mm512_loadu_si512((const void*)(b_lo + i)));
+                const unsigned r = _mm512_cmplt_epu64_mask(xh, yh) | _mm512_mask_cmpeq_epu64_mask(lt_lo, xh, yh);
+                for (size_t j = 0; j < 8; j++)
+                    out[i + j] = (r >> j) & 1;
+            }
+            batch_scalar::cmp_lt_n_soa(a_lo + i, a_hi + i, b_lo + i, b_hi + i, out + i, n - i);
+        }
+
+        U128_TARGET("avx512f")
+        static u128 sum_u64(const u64* a, size_t n) noexcept {
+            const __m512i one = _mm512_set1_epi64(1);
+            __m512i s0 = _mm512_setzero_si512(), s1 = s0, c0 = s0, c1 = s0;
+            size_t i = 0;
+            for (; i + 16 <= n; i += 16) {
+                const __m512i x0 = _mm512_loadu_si512((const void*)(a + i));
+                const __m512i x1 = _mm512_loadu_si512((const void*)(a + i + 8));
+                s0 = _mm512_add_epi64(s0, x0);
+                s1 = _mm512_add_epi64(s1, x1);
+                c0 = _mm512_mask_add_epi64(c0, _mm512_cmplt_epu64_mask(s0, x0), c0, one);
+                c1 = _mm512_mask_add_epi64(c1, _mm512_cmplt_epu64_mask(s1, x1), c1, one);
+            }
+            alignas(64) u64 s[16], c[16];
+            _mm512_store_si512((void*)s, s0);
+            _mm512_store_si512((void*)(s + 8), s1);
+            _mm512_store_si512((void*)c, c0);
+            _mm512_store_si512((void*)(c + 8), c1);
+            u128 sum = batch_scalar::sum_u64(a + i, n - i);
+            for (size_t j = 0; j < 16; j++)
+                sum += u128(s[j], c[j]);
+            return sum;
+        }
+    };
+
+#endif // U128_X86
+
+
+#if U128_NEON
+
+    // -----------------------------------------------------------------------------
+    // NEON: one u128 per 128 bit register, as [lo, hi]
+    // -----------------------------------------------------------------------------
+
+    struct batch_neon {
+        static void add_n(const u128* a, const u128* b, u128* out, size_t n) noexcept {
+            const uint64x2_t zero = vdupq_n_u64(0);
+            for (size_t i = 0; i < n; i++) {
+                const uint64x2_t x = vld1q_u64(&a[i].lo);
+                const uint64x2_t y = vld1q_u64(&b[i].lo);
+                const uint64x2_t s = vaddq_u64(x, y);
+                // [0, carry of lo], where the carry is all ones; subtracting adds 1
+                const uint64x2_t carry = vextq_u64(zero, vcltq_u64(s, x), 1);
+                vst1q_u64(&out[i].lo, vsubq_u64(s, carry));
+            }
+        }
+        static void xor_n(const u128* a, const u128* b, u128* out, size_t n) noexcept {
+            for (size_t i = 0; i < n; i++)
+                vst1q_u64(&out[i].lo, veorq_u64(vld1q_u64(&a[i].lo), vld1q_u64(&b[i].lo)));
+        }
+
+        // hi < hi' | (hi == hi' & lo < lo') for two u128 in lo and hi registers,
+        // as all ones / all zeros per lane.
+        static uint64x2_t lt(uint64x2_t x_lo, uint64x2_t x_hi, uint64x2_t y_lo, uint64x2_t y_hi) noexcept {
+            return vorrq_u64(vcltq_u64(x_hi, y_hi), vandq_u64(vceqq_u64(x_hi, y_hi), vcltq_u64(x_lo, y_lo)));
+        }
+        static void cmp_lt_n(const u128* a, const u128* b, bool* out, size_t n) noexcept {
+            size_t i = 0;
+            for (; i + 2 <= n; i += 2) {
+                // vld2q splits two u128 into a register of lo words and one of hi
+                const uint64x2x2_t x = vld2q_u64(&a[i].lo);
+                const uint64x2x2_t y = vld2q_u64(&b[i].lo);
+                const uint64x2_t r = lt(x.val[0], x.val[1], y.val[0], y.val[1]);
+                out[i] = vgetq_lane_u64(r, 0) & 1;
+                out[i + 1] = vgetq_lane_u64(r, 1) & 1;
+            }
+            batch_scalar::cmp_lt_n(a + i, b + i, out + i, n - i);
+        }
+        static void cmp_lt_n_soa(const u64* a_lo, const u64* a_hi, const u64* b_lo, const u64* b_hi,
+            bool* out, size_t n) noexcept {
+            size_t i = 0;
+            for (; i + 2 <= n; i += 2) {
+                const uint64x2_t r = lt(vld1q_u64(a_lo + i), vld1q_u64(a_hi + i), vld1q_u64(b_lo + i), vld1q_u64(b_hi + i));
+                out[i] = vgetq_lane_u64(r, 0) & 1;
+                out[i + 1] = vgetq_lane_u64(r, 1) & 1;
+            }
+            batch_scalar::cmp_lt_n_soa(a_lo + i, a_hi + i, b_lo + i, b_hi + i, out + i, n - i);
+        }
+        static u128 sum_u64(const u64* a, size_t n) noexcept {
+            uint64x2_t s0 = vdupq_n_u64(0), s1 = s0, c0 = s0, c1 = s0;
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                const uint64x2_t x0 = vld1q_u64(a + i);
+                const uint64x2_t x1 = vld1q_u64(a + i + 2);
+                s0 = vaddq_u64(s0, x0);
+                s1 = vaddq_u64(s1, x1);
+                c0 = vsubq_u64(c0, vcltq_u64(s0, x0));
+                c1 = vsubq_u64(c1, vcltq_u64(s1, x1));
+            }
+            u128 sum = batch_scalar::sum_u64(a + i, n - i);
+            sum += u128(vgetq_lane_u64(s0, 0), vgetq_lane_u64(c0, 0));
+            sum += u128(vgetq_lane_u64(s0, 1), vgetq_lane_u64(c0, 1));
+            sum += u128(vgetq_lane_u64(s1, 0), vgetq_lane_u64(c1, 0));
+            sum += u128(vgetq_lane_u64(s1, 1), vgetq_lane_u64(c1, 1));
+            return sum;
+        }
+    };
+
+#endif // U128_NEON
+
+
+    // -----------------------------------------------------------------------------
+    // Dispatch
+    // -----------------------------------------------------------------------------
+
+    // The set of batch kernels chosen for this CPU.
+    //
+    // mul64_n and hash_n stay scalar on every target: there is no vector 64×64 →
+    // 128 multiply, and emulating one from 32 bit products costs more than the
+    // scalar mul (mulx on BMI2) it replaces. AVX-512 IFMA52 multiplies only 52 bit
+    // operands, so full 64 bit products would need four of them plus the
+    // recombination.
+    struct batch_kernels {
+        void (*add_n)(const u128*, const u128*, u128*, size_t) noexcept;
+        void (*xor_n)(const u128*, const u128*, u128*, size_t) noexcept;
+        void (*cmp_lt_n)(const u128*, const u128*, bool*, size_t) noexcept;
+        void (*mul64_n)(const u64*, const u64*, u128*, size_t) noexcept;
+        void (*hash_n)(const u128*, size_t*, size_t, u64) noexcept;
+        void (*add_n_soa)(const u64*, const u64*, const u64*, const u64*, u64*, u64*, size_t) noexcept;
+        void (*cmp_lt_n_soa)(const u64*, const u64*, const u64*, const u64*, bool*, size_t) noexcept;
+        u128 (*sum_u64)(const u64*, size_t) noexcept;
+        const char* isa;
+    };
+
+    inline batch_kernels select_batch_kernels(const cpu_features& f) noexcept {
+        batch_kernels k = {
+            batch_scalar::add_n, batch_scalar::xor_n, batch_scalar::cmp_lt_n,
+            batch_scalar::mul64_n, batch_scalar::hash_n,
+            batch_scalar::add_n_soa, batch_scalar::cmp_lt_n_soa,
+            batch_scalar::sum_u64, "scalar"
+        };
+#if U128_X86
+        if (f.avx512f) {
+            k.add_n = batch_avx512::add_n;
+            k.xor_n = batch_avx512::xor_n;
+            k.cmp_lt_n = batch_avx512::cmp_lt_n;
+            k.add_n_soa = batch_avx512::add_n_soa;
+            k.cmp_lt_n_soa = batch_avx512::cmp_lt_n_soa;
+            k.sum_u64 = batch_avx512::sum_u64;
+            k.isa = "avx512";
+        }
+        else if (f.avx2) {
+            k.add_n = batch_avx2::add_n;
+            k.xor_n = batch_avx2::xor_n;
+            k.cmp_lt_n = batch_avx2::cmp_lt_n;
+            k.add_n_soa = batch_avx2::add_n_soa;
+            k.cmp_lt_n_soa = batch_avx2::cmp_lt_n_soa;
+            k.sum_u64 = batch_avx2::sum_u64;
+            k.isa = "avx2";
+        }
+#elif U128_NEON
+        if (f.neon) {
+            k.add_n = batch_neon::add_n;
+            k.xor_n = batch_neon::xor_n;
+            k.cmp_lt_n = batch_neon::cmp_lt_n;
+            k.cmp_lt_n_soa = batch_neon::cmp_lt_n_soa;
+            k.sum_u64 = batch_neon::sum_u64;
+            k.isa = "neon";
+        }
+#else
+        (void)f;
+#endif
+        return k;
+    }
+
+    // The kernels for the running CPU, chosen on first use.
+    inline const batch_kernels& batch() noexcept {
+        static const batch_kernels kernels = select_batch_kernels(cpu());
+        return kernels;
+    }
+
+    inline void add_n(const u128* a, const u128* b, u128* out, size_t n) noexcept {
+        batch().add_n(a, b, out, n);
+    }
+    inline void xor_n(const u128* a, const u128* b, u128* out, size_t n) noexcept {
+        batch().xor_n(a, b, out, n);
+    }
+    inline void cmp_lt_n(const u128* a, const u128* b, bool* out, size_t n) noexcept {
+        batch().cmp_lt_n(a, b, out, n);
+    }
+    inline void mul64_n(const u64* a, const u64* b, u128* out, size_t n) noexcept {
+        batch().mul64_n(a, b, out, n);
+    }
+    inline void hash_n(const u128* keys, size_t* out, size_t n, u64 seed = 0) noexcept {
+        batch().hash_n(keys, out, n, seed);
+    }
+    inline void add_n_soa(const u64* a_lo, const u64* a_hi, const u64* b_lo, const u64* b_hi,
+        u64* out_lo, u64* out_hi, size_t n) noexcept {
+        batch().add_n_soa(a_lo, a_hi, b_lo, b_hi, out_lo, out_hi, n);
+    }
+    inline void cmp_lt_n_soa(const u64* a_lo, const u64* a_hi, const u64* b_lo, const u64* b_hi,
+        bool* out, size_t n) noexcept {
+        batch().cmp_lt_n_soa(a_lo, a_hi, b_lo, b_hi, out, n);
+    }
+    inline const char* batch_isa() noexcept {
+        return batch().isa;
+    }
+
+
+    // -----------------------------------------------------------------------------
+    // Reductions and prefix sums
+    // -----------------------------------------------------------------------------
+
+    // Below this many elements per thread, starting the thread costs more than
+    // it saves.
+    static constexpr size_t REDUCE_MIN_PER_THREAD = size_t(1) << 16;
+
+    inline u128 sum_u64_to_u128(const u64* a, size_t n, unsigned threads = 1) {
+        threads = thread_count(threads, n, REDUCE_MIN_PER_THREAD);
+        if (threads == 1)
+            return batch().sum_u64(a, n);
+        const size_t chunk = (n + threads - 1) / threads;
+        std::vector<u128> part(threads);
+        parallel_for(threads, [&](unsigned t) {
+            const size_t first = std::min(n, t * chunk), last = std::min(n, first + chunk);
+            part[t] = batch().sum_u64(a + first, last - first);
+        });
+        u128 sum;
+        for (const u128& p : part)
+            sum += p;
+        return sum;
+    }
+
+    // Scalar, as mul64_n. Four accumulators keep four products in flight, so
+    // the loop runs at the multiplier's throughput rather than waiting on one
+    // accumulator's add with carry.
+    inline u128 dot_u64_serial(const u64* a, const u64* b, size_t n) noexcept {
+        u128 s0, s1, s2, s3;
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            s0 += mul64(a[i], b[i]);
+            s1 += mul64(a[i + 1], b[i + 1]);
+            s2 += mul64(a[i + 2], b[i + 2]);
+            s3 += mul64(a[i + 3], b[i + 3]);
+        }
+        for (; i < n; i++)
+            s0 += mul64(a[i], b[i]);
+        return (s0 + s1) + (s2 + s3);
+    }
+
+    inline u128 dot_u64(const u64* a, const u64* b, size_t n, unsigned threads = 1) {
+        threads = thread_count(threads, n, REDUCE_MIN_PER_THREAD);
+        if (threads == 1)
+            return dot_u64_serial(a, b, n);
+        const size_t chunk = (n + threads - 1) / threads;
+        std::vector<u128> part(threads);
+        parallel_for(threads, [&](unsigned t) {
+            const size_t first = std::min(n, t * chunk), last = std::min(n, first + chunk);
+            part[t] = dot_u64_serial(a + first, b + first, last - first);
+        });
+        u128 sum;
+        for (const u128& p : part)
+            sum += p;
+        return sum;
+    }
+
+    // out[i] = init + in[0] + … + in[i]. Each element is one add and one add
+    // with carry after the previous one, already about as fast as the loads and
+    // stores, so there is no vector version.
+    inline void inclusive_scan_serial(const u128* in, u128* out, size_t n, u128 init = u128()) noexcept {
+        for (size_t i = 0; i < n; i++) {
+            init += in[i];
+            out[i] = init;
+        }
+    }
+
+    // With threads: each thread sums its part, and then scans it starting from
+    // the total of the parts before it. That reads the input twice, so it only
+    // gains with memory bandwidth to spare for more than one core.
+    inline void inclusive_scan(const u128* in, u128* out, size_t n, unsigned threads = 1) {
+        threads = thread_count(threads, n, REDUCE_MIN_PER_THREAD);
+        if (threads == 1) {
+            inclusive_scan_serial(in, out, n);
+            return;
+        }
+        const size_t chunk = (n + threads - 1) / threads;
+        std::vector<u128> offset(threads);
+        parallel_for(threads, [&](unsigned t) {
+            // the last part's total is never needed
+            if (t + 1 < threads) {
+                const size_t first = t * chunk, last = std::min(n, first + chunk);
+                u128 sum;
+                for (size_t i = first; i < last; i++)
+                    sum += in[i];
+                offset[t + 1] = sum;
+            }
+        });
+        for (unsigned t = 1; t < threads; t++)
+            offset[t] += offset[t - 1];
+        parallel_for(threads, [&](unsigned t) {
+            const size_t first = std::min(n, t * chunk), last = std::min(n, first + chunk);
+            inclusive_scan_serial(in + first, out + first, last - first, offset[t]);
+        });
+    }
+
+
+#if U128_SELF_TEST
+
+    // -----------------------------------------------------------------------------
+    // Self test
+    // -----------------------------------------------------------------------------
+
+    // Every batch kernel set this CPU can run (the one for cpu() and those for
+    // cpu() with its widest features taken away, scalar last) against the u128.h
+    // operations, for every length up to 70 so that every tail is covered, and
+    // at offsets that break vector alignment; then the threaded reductions
+    // against plain loops, with and without threads.
+    inline int test_batch_kernels(u64 seed = 1) {
+        std::mt19937_64 rng(seed);
+        int failures = 0;
+
+        std::vector<batch_kernels> sets;
+        cpu_features f = cpu();
+        sets.push_back(select_batch_kernels(f));
+        if (f.avx512f && f.avx2) {
+            cpu_features no_avx2 = f;           // as some VMs report
+            no_avx2.avx2 = false;
+            sets.push_back(select_batch_kernels(no_avx2));
+        }
+        f.avx512f = f.avx512ifma = false;
+        sets.push_back(select_batch_kernels(f));
+        f.avx2 = f.neon = false;
+        sets.push_back(select_batch_kernels(f));
+
+        constexpr size_t max_n = 70;
+        std::vector<u128> a(max_n + 1), b(max_n + 1), out(max_n + 1);
+        std::vector<u64> a64(2 * max_n + 2), b64(2 * max_n + 2), out_lo(max_n), out_hi(max_n);
+        std::vector<size_t> h(max_n);
+        bool lt[max_n];
+        for (size_t i = 0; i <= max_n; i++) {
+            a[i] = self_test_u128(rng);
+            b[i] = rng() % 4 ? self_test_u128(rng) : a[i] + (rng() % 3) - ONE;    // near a[i] too
+        }
+        for (size_t i = 0; i < a64.size(); i++) {
+            a64[i] = self_test_u64(rng);
+            b64[i] = self_test_u64(rng);
+        }
+
+        const std::hash<u128> hash;
+        for (const batch_kernels& k : sets) {
+            for (size_t off = 0; off < 2; off++) {
+                const u128* pa = a.data() + off;
+                const u128* pb = b.data() + off;
+                const u64* pa64 = a64.data() + off;
+                const u64* pb64 = b64.data() + off;
+                const u64* a_lo = a64.data() + off;             // structure of arrays
+                const u64* a_hi = a64.data() + max_n + 1;
+                const u64* b_lo = b64.data() + off;
+                const u64* b_hi = b64.data() + max_n + 1;
+                for (size_t n = 0; n <= max_n - off; n++) {
+                    auto check = [&](bool ok, const char* what) {
+                        if (!ok)
+                            failures += self_test_fail(what, k.isa, std::to_string(n) + " at " + std::to_string(off));
+                    };
+                    bool ok = true;
+                    k.add_n(pa, pb, out.data(), n);
+                    for (size_t i = 0; i < n; i++)
+                        ok &= out[i] == pa[i] + pb[i];
+                    check(ok, "add_n");
+                    ok = true;
+                    k.xor_n(pa, pb, out.data(), n);
+                    for (size_t i = 0; i < n; i++)
+                        ok &= out[i] == (pa[i] ^ pb[i]);
+                    check(ok, "xor_n");
+                    ok = true;
+                    k.cmp_lt_n(pa, pb, lt, n);
+                    for (size_t i = 0; i < n; i++)
+                        ok &= lt[i] == (pa[i] < pb[i]);
+                    check(ok, "cmp_lt_n");
+                    ok = true;
+                    k.mul64_n(pa64, pb64, out.data(), n);
+                    for (size_t i = 0; i < n; i++)
+                        ok &= out[i] == mul64(pa64[i], pb64[i]);
+                    check(ok, "mul64_n");
+                    ok = true;
+                    k.hash_n(pa, h.data(), n, 0);
+                    for (size_t i = 0; i < n; i++)
+                        ok &= h[i] == hash(pa[i]);
+                    k.hash_n(pa, h.data(), n, seed);
+                    for (size_t i = 0; i < n; i++)
+                        ok &= h[i] == (size_t)hash128(pa[i], seed);
+                    check(ok, "hash_n");
+                    ok = true;
+                    k.add_n_soa(a_lo, a_hi, b_lo, b_hi, out_lo.data(), out_hi.data(), n);
+                    for (size_t i = 0; i < n; i++)
+                        ok &= u128(out_lo[i], out_hi[i]) == u128(a_lo[i], a_hi[i]) + u128(b_lo[i], b_hi[i]);
+                    check(ok, "add_n_soa");
+                    ok = true;
+                    k.cmp_lt_n_soa(a_lo, a_hi, b_lo, b_hi, lt, n);
+                    for (size_t i = 0; i < n; i++)
+                        ok &= lt[i] == (u128(a_lo[i], a_hi[i]) < u128(b_lo[i], b_hi[i]));
+                    check(ok, "cmp_lt_n_soa");
+                    u128 sum;
+                    for (size_t i = 0; i < n; i++)
+                        sum += pa64[i];
+                    check(k.sum_u64(pa64, n) == sum, "sum_u64");
+                }
+            }
+        }
+
+        // Values that carry often, in sizes too small to split and sizes that
+        // split unevenly over two and three threads.
+        for (size_t n : { size_t(0), size_t(5), 2 * REDUCE_MIN_PER_THREAD + 1, 3 * REDUCE_MIN_PER_THREAD + 5 }) {
+            std::vector<u64> x(n), y(n);
+            std::vector<u128> in(n), scan(n);
+            for (size_t i = 0; i < n; i++) {
+                x[i] = UINT64_MAX - (rng() & 0xffff);
+                y[i] = i % 2 ? UINT64_MAX : self_test_u64(rng);
+                in[i] = self_test_u128(rng);
+            }
+            u128 sum, dot;
+            for (size_t i = 0; i < n; i++) {
+                sum += x[i];
+                dot += mul64(x[i], y[i]);
+            }
+            for (unsigned threads : { 1u, 3u, 0u }) {
+                const std::string t = std::to_string(n) + ", " + std::to_string(threads) + " threads";
+                if (sum_u64_to_u128(x.data(), n, threads) != sum)
+                    failures += self_test_fail("sum_u64_to_u128", t);
+                if (dot_u64(x.data(), y.data(), n, threads) != dot || dot_u64_serial(x.data(), y.data(), n) != dot)
+                    failures += self_test_fail("dot_u64", t);
+                inclusive_scan(in.data(), scan.data(), n, threads);
+                u128 running;
+                bool ok = true;
+                for (size_t i = 0; i < n; i++) {
+                    running += in[i];
+                    ok &= scan[i] == running;
+                }
+                if (!ok)
+                    failures += self_test_fail("inclusive_scan", t);
+            }
+        }
+        return failures;
+    }
+
+#endif
+
+} // namespace u128
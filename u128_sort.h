@@ -0,0 +1,371 @@
+#pragma once
+// file u128_sort.h
+
+// void radix_sort(u128* keys, size_t n, unsigned threads = 1)
+// void radix_sort(u128* keys, V* values, size_t n, unsigned threads = 1)
+//      Stable LSD radix sort, 11 bits per pass, of keys (and values[i] along
+//      with keys[i]). All 12 digit histograms come from a single read of the
+//      keys, and digits that are the same in every key get no pass at all: keys
+//      below 2⁶⁴, or sharing a hi word, take at most 6 passes. threads > 1
+//      splits each pass over that many threads; 0 means one per hardware
+//      thread. Uses a scratch copy of the arrays.
+//
+// const u128* branchless_lower_bound(const u128* first, const u128* last, const u128& key)
+//      std::lower_bound on a sorted array, with conditional moves instead of
+//      branches, so no mispredicted comparisons.
+//
+// class eytzinger_index
+//      A copy of a sorted array in breadth-first (Eytzinger) order, where the
+//      nodes a search visits next are adjacent and can be prefetched; faster
+//      than binary search once the array is larger than the caches.
+//
+// int test_sort(u64 seed = 1)
+//      With U128_SELF_TEST, checks the sort against std::stable_sort and the
+//      searches against std::lower_bound; returns the number of failures.
+
+#include "u128.h"
+#include "u128_cpu.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+namespace u128 {
+
+    // -----------------------------------------------------------------------------
+    // Radix sort
+    // -----------------------------------------------------------------------------
+
+    // 11 bit digits: 12 passes at most rather than 16 for bytes, for a small
+    // cost per pass (2048 buckets to scatter to instead of 256).
+    static constexpr unsigned RADIX_BITS = 11;
+    static constexpr unsigned RADIX_DIGITS = (128 + RADIX_BITS - 1) / RADIX_BITS;
+    static constexpr size_t RADIX_BUCKETS = size_t(1) << RADIX_BITS;
+
+    // Digit b (0 the lowest) of k.
+    inline size_t radix_digit(const u128& k, unsigned b) noexcept {
+        return (size_t)(k >> (RADIX_BITS * b)).lo & (RADIX_BUCKETS - 1);
+    }
+
+    // Counts the digits of keys [first, last) into h[b * RADIX_BUCKETS + digit].
+    inline void radix_count(const u128* first, const u128* last, size_t* h) noexcept {
+        constexpr u64 M = RADIX_BUCKETS - 1;
+        for (; first != last; ++first) {
+            const u64 lo = first->lo, hi = first->hi;
+            h[0 * RADIX_BUCKETS + (lo & M)]++;
+            h[1 * RADIX_BUCKETS + ((lo >> 11) & M)]++;
+            h[2 * RADIX_BUCKETS + ((lo >> 22) & M)]++;
+            h[3 * RADIX_BUCKETS + ((lo >> 33) & M)]++;
+            h[4 * RADIX_BUCKETS + ((lo >> 44) & M)]++;
+            h[5 * RADIX_BUCKETS + (((lo >> 55) | (hi << 9)) & M)]++;
+            h[6 * RADIX_BUCKETS + ((hi >> 2) & M)]++;
+            h[7 * RADIX_BUCKETS + ((hi >> 13) & M)]++;
+            h[8 * RADIX_BUCKETS + ((hi >> 24) & M)]++;
+            h[9 * RADIX_BUCKETS + ((hi >> 35) & M)]++;
+            h[10 * RADIX_BUCKETS + ((hi >> 46) & M)]++;
+            h[11 * RADIX_BUCKETS + (hi >> 57)]++;
+        }
+    }
+
+    // Stands in for the values array of a key only sort.
+    struct radix_no_values {};
+
+    template<typename V>
+    void radix_sort_impl(u128* keys, V* values, size_t n, unsigned threads) {
+        constexpr bool has_values = !std::is_same<V, radix_no_values>::value;
+
+        // Small arrays: insertion sort, which is stable as well.
+        if (n < 64) {
+            for (size_t i = 1; i < n; i++) {
+                const u128 k = keys[i];
+                size_t j = i;
+                if constexpr (has_values) {
+                    V v = std::move(values[i]);
+                    for (; j > 0 && k < keys[j - 1]; j--) {
+                        keys[j] = keys[j - 1];
+                        values[j] = std::move(values[j - 1]);
+                    }
+                    values[j] = std::move(v);
+                }
+                else {
+                    for (; j > 0 && k < keys[j - 1]; j--)
+                        keys[j] = keys[j - 1];
+                }
+                keys[j] = k;
+            }
+            return;
+        }
+
+        threads = thread_count(threads, n, 65536);
+        const size_t chunk = (n + threads - 1) / threads;
+        auto chunk_begin = [&](unsigned t) { return std::min(n, t * chunk); };
+
+        // Histograms of every digit of each thread's part of the keys.
+        using counts = std::vector<size_t>;     // [b * RADIX_BUCKETS + digit b]
+        std::vector<counts> hist(threads, counts(RADIX_DIGITS * RADIX_BUCKETS));
+        parallel_for(threads, [&](unsigned t) {
+            radix_count(keys + chunk_begin(t), keys + chunk_begin(t + 1), hist[t].data());
+        });
+
+        // A pass over a digit that is the same in all keys would change nothing.
+        unsigned passes[RADIX_DIGITS];
+        unsigned npasses = 0;
+        for (unsigned b = 0; b < RADIX_DIGITS; b++) {
+            const size_t d = radix_digit(keys[0], b);
+            size_t same = 0;
+            for (unsigned t = 0; t < threads; t++)
+                same += hist[t][b * RADIX_BUCKETS + d];
+            if (same != n)
+                passes[npasses++] = b;
+        }
+        if (npasses == 0)
+            return;
+
+        std::vector<u128> key_buf(n);
+        std::vector<std::conditional_t<has_values, V, radix_no_values>> value_buf(has_values ? n : 0);
+        u128* src = keys;
+        u128* dst = key_buf.data();
+        V* src_v = values;
+        V* dst_v = nullptr;
+        if constexpr (has_values)
+            dst_v = value_buf.data();
+
+        std::vector<size_t> offsets(threads * RADIX_BUCKETS);
+        for (unsigned p = 0; p < npasses; p++) {
+            const unsigned b = passes[p];
+
+            // Each thread's counts for this digit. The first pass can use the
+            // histograms above; after that the keys have moved between parts.
+            if (threads > 1 && p > 0) {
+                parallel_for(threads, [&](unsigned t) {
+                    size_t* h = hist[t].data() + b * RADIX_BUCKETS;
+                    std::fill(h, h + RADIX_BUCKETS, size_t(0));
+                    for (size_t i = chunk_begin(t), e = chunk_begin(t + 1); i < e; i++)
+                        h[radix_digit(src[i], b)]++;
+                });
+            }
+
+            // Thread t writes digit d after all smaller digits, and after the
+            // digit d keys of threads before it, which keeps the sort stable.
+            size_t sum = 0;
+            for (size_t d = 0; d < RADIX_BUCKETS; d++) {
+                for (unsigned t = 0; t < threads; t++) {
+                    offsets[t * RADIX_BUCKETS + d] = sum;
+                    sum += hist[t][b * RADIX_BUCKETS + d];
+                }
+            }
+
+            parallel_for(threads, [&](unsigned t) {
+                size_t* off = offsets.data() + t * RADIX_BUCKETS;
+                for (size_t i = chunk_begin(t), e = chunk_begin(t + 1); i < e; i++) {
+                    const size_t j = off[radix_digit(src[i], b)]++;
+                    dst[j] = src[i];
+                    if constexpr (has_values)
+                        dst_v[j] = std::move(src_v[i]);
+                }
+            });
+
+            std::swap(src, dst);
+            if constexpr (has_values)
+                std::swap(src_v, dst_v);
+        }
+
+        // After an odd number of passes the result is in the scratch arrays.
+        if (src != keys) {
+            std::copy(src, src + n, keys);
+            if constexpr (has_values)
+                std::move(src_v, src_v + n, values);
+        }
+    }
+
+    inline void radix_sort(u128* keys, size_t n, unsigned threads = 1) {
+        radix_sort_impl(keys, (radix_no_values*)nullptr, n, threads);
+    }
+
+    // V must be default constructible and move assignable.
+    template<typename V>
+    void radix_sort(u128* keys, V* values, size_t n, unsigned threads = 1) {
+        radix_sort_impl(keys, values, n, threads);
+    }
+
+
+    // -----------------------------------------------------------------------------
+    // Searching sorted arrays
+    // -----------------------------------------------------------------------------
+
+    // a < b evaluating both halves, so that the result feeds a conditional move
+    // rather than the two branches of operator<.
+    inline bool less_branchless(const u128& a, const u128& b) noexcept {
+        return (a.hi < b.hi) | ((a.hi == b.hi) & (a.lo < b.lo));
+    }
+
+    // The first element of the sorted range [first, last) that is not less than
+    // key, or last. Always takes ⌈log₂ n⌉ + 1 steps, each one load and one
+    // conditional move, prefetching both elements the following step may need.
+    inline const u128* branchless_lower_bound(const u128* first, const u128* last, const u128& key) noexcept {
+        size_t len = (size_t)(last - first);
+        if (len == 0)
+            return first;
+        while (len > 1) {
+            const size_t half = len / 2;
+#if defined(__GNUC__)
+            // both elements the next step may compare
+            __builtin_prefetch(first + half / 2);
+            __builtin_prefetch(first + half + half / 2);
+#endif
+            first = less_branchless(first[half], key) ? first + half : first;
+            len -= half;
+        }
+        return first + less_branchless(*first, key);
+    }
+
+    // A sorted array rearranged so that node k has children 2k and 2k + 1 (from
+    // 1), i.e. in the order a binary search meets the elements. The 16 nodes
+    // four levels below k are adjacent, so a search prefetches them while it
+    // compares k, and usually finds the next nodes in cache.
+    class eytzinger_index {
+    public:
+        eytzinger_index() = default;
+
+        // sorted[0, n) must be in ascending order.
+        eytzinger_index(const u128* sorted, size_t n) : tree_(n + 1), index_(n + 1) {
+            size_t next = 0;
+            build(sorted, next, 1);
+        }
+
+        size_t size() const noexcept { return tree_.empty() ? 0 : tree_.size() - 1; }
+
+        // The position in the original sorted array of the first element not
+        // less than key, or size() if there is none, as std::lower_bound.
+        size_t lower_bound(const u128& key) const noexcept {
+            const size_t k = lower_bound_node(key);
+            return k == 0 ? size() : index_[k];
+        }
+
+        // True if key is in the array.
+        bool contains(const u128& key) const noexcept {
+            const size_t k = lower_bound_node(key);
+            return k != 0 && tree_[k] == key;
+        }
+
+    private:
+        // The node of the first element not less than key, or 0.
+        size_t lower_bound_node(const u128& key) const noexcept {
+            const size_t n = size();
+            const u128* t = tree_.data();
+            size_t k = 1;
+            while (k <= n) {
+#if defined(__GNUC__)
+                // the 16 nodes four levels down, 256 bytes; past the end of
+                // the tree near the leaves, so the address is computed as an
+                // integer (prefetches never fault)
+                const uintptr_t next = reinterpret_cast<uintptr_t>(t) + 16 * k * sizeof(u128);
+                for (size_t j = 0; j < 16; j += 4)
+                    __builtin_prefetch(reinterpret_cast<const void*>(next + j * sizeof(u128)));
+#endif
+                k = 2 * k + less_branchless(t[k], key);
+            }
+            // The path went right while the node was less than key: drop those
+            // right turns and the last left one to get the answer's node.
+            return k >> (countr_zero64(~(u64)k) + 1);
+        }
+
+        void build(const u128* sorted, size_t& next, size_t k) {
+            if (k < tree_.size()) {
+                build(sorted, next, 2 * k);
+                index_[k] = next;
+                tree_[k] = sorted[next++];
+                build(sorted, next, 2 * k + 1);
+            }
+        }
+
+        std::vector<u128> tree_;        // tree_[0] is unused
+        std::vector<size_t> index_;     // position of each node in the sorted array
+    };
+
+
+#if U128_SELF_TEST
+
+    // -----------------------------------------------------------------------------
+    // Self test
+    // -----------------------------------------------------------------------------
+
+    // radix_sort against std::stable_sort, keys alone and with values (their
+    // original positions, which shows stability), one and three threads, on
+    // sizes around the insertion sort cut-off and on keys that leave different
+    // sets of digits constant; then the searches against std::lower_bound.
+    inline int test_sort(u64 seed = 1) {
+        std::mt19937_64 rng(seed);
+        int failures = 0;
+        const char* shapes[] = { "mixed", "below 2^64", "one hi word", "four values", "constant" };
+        for (size_t n : { size_t(0), size_t(1), size_t(2), size_t(63), size_t(64), size_t(65), size_t(1000), size_t(200000) }) {
+            for (int shape = 0; shape < 5; shape++) {
+                std::vector<u128> keys(n);
+                const u64 hi = rng();
+                for (u128& k : keys) {
+                    switch (shape) {
+                    case 0: k = self_test_u128(rng); break;
+                    case 1: k = u128(rng()); break;
+                    case 2: k = u128(rng() >> (rng() % 64), hi); break;
+                    case 3: k = u128(rng() % 4, hi); break;
+                    default: k = u128(hi, hi); break;
+                    }
+                }
+                std::vector<std::pair<u128, size_t>> expect(n);
+                for (size_t i = 0; i < n; i++)
+                    expect[i] = { keys[i], i };
+                std::stable_sort(expect.begin(), expect.end(),
+                    [](const auto& x, const auto& y) { return x.first < y.first; });
+
+                for (unsigned threads : { 1u, 3u }) {
+                    const std::string what = std::to_string(n) + " " + shapes[shape] + ", " + std::to_string(threads) + " threads";
+                    std::vector<u128> sorted = keys, with_values = keys;
+                    std::vector<size_t> values(n);
+                    for (size_t i = 0; i < n; i++)
+                        values[i] = i;
+                    radix_sort(sorted.data(), n, threads);
+                    radix_sort(with_values.data(), values.data(), n, threads);
+                    bool ok = true, stable = true;
+                    for (size_t i = 0; i < n; i++) {
+                        ok &= sorted[i] == expect[i].first;
+                        stable &= with_values[i] == expect[i].first && values[i] == expect[i].second;
+                    }
+                    if (!ok)
+                        failures += self_test_fail("radix_sort", what);
+                    if (!stable)
+                        failures += self_test_fail("radix_sort with values", what);
+                }
+                if (n > 1000)
+                    continue;
+
+                // every key, its neighbours and the extremes
+                std::vector<u128> sorted(n);
+                for (size_t i = 0; i < n; i++)
+                    sorted[i] = expect[i].first;
+                const eytzinger_index index(sorted.data(), n);
+                std::vector<u128> queries = { ZERO, ONE, MAX };
+                for (const u128& k : keys) {
+                    queries.push_back(k);
+                    queries.push_back(k - ONE);
+                    queries.push_back(k + ONE);
+                }
+                for (const u128& q : queries) {
+                    const u128* want = std::lower_bound(sorted.data(), sorted.data() + n, q);
+                    const bool found = want != sorted.data() + n && *want == q;
+                    if (branchless_lower_bound(sorted.data(), sorted.data() + n, q) != want)
+                        failures += self_test_fail("branchless_lower_bound", q.to_string(), std::to_string(n));
+                    if (index.size() != n || index.lower_bound(q) != (size_t)(want - sorted.data()) || index.contains(q) != found)
+                        failures += self_test_fail("eytzinger_index", q.to_string(), std::to_string(n));
+                }
+            }
+        }
+        return failures;
+    }
+
+#endif
+
+} // namespace u128